@@ -11,8 +11,11 @@
 #include "parser/Parser.h"
 
 #include "ui/GraphicalUI.h"
+#include "fileio/bitmap.h"
+#include "scene/timeline.h"
 #include <cmath>
 #include <algorithm>
+#include <chrono>
 
 extern TraceUI* traceUI;
 extern GraphicalUI* graphicalUI;
@@ -33,14 +36,22 @@ bool debugMode = false;
 // in an initial ray weight of (0.0,0.0,0.0) and an initial recursion depth of 0.
 
 Vec3d RayTracer::trace(double x, double y)
+{
+  Vec3d ret = radiance(x, y);
+  ret.clamp();
+  return ret;
+}
+
+Vec3d RayTracer::radiance(double x, double y, bool* hit, double time)
 {
   // Clear out the ray cache in the scene for debugging purposes,
   if (TraceUI::m_debug) scene->intersectCache.clear();
   ray r(Vec3d(0,0,0), Vec3d(0,0,0), ray::VISIBILITY);
   scene->getCamera().rayThrough(x,y,r);
-  Vec3d ret = traceRay(r, traceUI->getDepth());
-  ret.clamp();
-  return ret;
+  r.setTime(time);
+  // one pixel's worth of angle, for texture filtering
+  r.setCone(0.0, scene->getCamera().getV().length() / std::max(buffer_height, 1));
+  return traceRay(r, traceUI->getDepth(), hit);
 }
 
 Vec3d RayTracer::tracePixel(int i, int j)
@@ -52,25 +63,61 @@ Vec3d RayTracer::tracePixel(int i, int j)
 	double x = double(i)/double(buffer_width);
 	double y = double(j)/double(buffer_height);
 
-	unsigned char *pixel = buffer + ( i + j * buffer_width ) * 3;
+	int samples = scene->hasMotion() ? std::max(traceUI->getMotionSamples(), 1) : 1;
+	double before = costBuffer.empty() ? 0.0 : costMark();
+
+	frame.clearPixel(i, j);
+	for( int k = 0; k < samples; ++k ) {
+		bool hit = false;
+		Vec3d c = radiance(x, y, &hit, shutterTime(i, j, k, samples));
+		frame.addSample(i, j, c, hit ? 1.0 : 0.0);
+		col += c;
+	}
+	col /= samples;
 
-	col = trace(x, y);
+	if( !costBuffer.empty() )
+		costBuffer[i + j * buffer_width] += float( costMark() - before );
 
-	pixel[0] = (int)( 255.0 * col[0]);
-	pixel[1] = (int)( 255.0 * col[1]);
-	pixel[2] = (int)( 255.0 * col[2]);
+	frame.toBytes(i, j, buffer + ( i + j * buffer_width ) * 3);
 	return col;
 }
 
+// One time in each of the n equal slices of the shutter, jittered within
+// its slice.  The jitter is hashed from the pixel rather than drawn, so
+// a frame rendered in parts has the same samples as one rendered whole.
+double RayTracer::shutterTime(int i, int j, int k, int n)
+{
+	if( n <= 1 ) return 0.0;
+	unsigned h = unsigned(i) * 73856093u ^ unsigned(j) * 19349663u ^ unsigned(k) * 83492791u;
+	h ^= h >> 16;
+	h *= 0x7feb352du;
+	h ^= h >> 15;
+	h *= 0x846ca68bu;
+	h ^= h >> 16;
+	return ( k + ( h >> 8 ) / double(1 << 24) ) / n;
+}
+
+void RayTracer::addSample(int i, int j, double x, double y, double time)
+{
+	if( ! sceneLoaded() ) return;
+
+	bool hit = false;
+	Vec3d col = radiance(x, y, &hit, time);
+	frame.addSample(i, j, col, hit ? 1.0 : 0.0);
+	frame.toBytes(i, j, buffer + ( i + j * buffer_width ) * 3);
+}
+
 
 // Do recursive ray tracing!  You'll want to insert a lot of code here
 // (or places called from here) to handle reflection, refraction, etc etc.
-Vec3d RayTracer::traceRay(ray& r, int depth)
+Vec3d RayTracer::traceRay(ray& r, int depth, bool* hit)
 {
 	isect i;
 	Vec3d colorC;
 
-	if(scene->intersect(r, i)) {
+	bool found = scene->intersect(r, i);
+	if(hit) *hit = found;
+	if(found) {
 		// YOUR CODE HERE
 
 		// An intersection occurred!  We've got work to do.  For now,
@@ -88,69 +135,281 @@ Vec3d RayTracer::traceRay(ray& r, int depth)
 	  		return colorC;
 	  	}
 
-	  	//reflection
-	  	Vec3d N = i.N;
-	    Vec3d L = -r.d; //opposite of ray direction
-	    L.normalize();
-
-	    Vec3d dirReflect = 2*max((L*N), 0.0)*N-L;
-	    dirReflect.normalize();
-
-	    ray reflect(r.at(i.t), dirReflect, ray :: REFLECTION);
+	  	ray reflect(r), refract(r);
+	  	bool leaving;
+	  	bool refracts = spawnRays(r, i, reflect, refract, leaving);
 
 	    colorC += m.kr(i) % traceRay(reflect, depth-1);
 
-
-		//refraction
-		double yita_i=1.0;// = m.index(i); //object = i
-	    double yita_t=1.0;// = 1.0; //air =t
-	    double yita=1.0;// = yita_i/yita_t;
-		double cosine_i = N * L;
-		double flag = 1;
-	    if(cosine_i>0){
-	    	yita_i = 1.0; //air = i
-		    yita_t = m.index(i); //object =t
-		    yita = yita_i/yita_t;
-		    
-	    }else{
-	    	yita_i = m.index(i); //object = i
-		    yita_t = 1.0; //air =t
-		    yita = yita_i/yita_t;
+	    // light leaving an object picks up nothing from its surface
+	    if(leaving){
 		    colorC -= m.shade(scene, r, i);
-		    
-		    flag = -1;
-
-		    double sine_i = sqrt(1 - cosine_i*cosine_i);
-		    double sine_t = yita * sine_i;
-		    if(sine_t>1){
-		    	return colorC;
-		    }
+	    }
+	    if(!refracts){
+	    	return colorC;
 	    }
 
-	    double cosine_t = sqrt(1-yita*yita*(1-cosine_i*cosine_i));
-
-	    Vec3d dirRefract = (yita*cosine_i - cosine_t * flag) * N  - yita * L;
-	    dirRefract.normalize();
-	    ray refract(r.at(i.t), dirRefract, ray :: REFRACTION);
 	    colorC += m.kt(i) % traceRay(refract, depth-1);
 
 	  
 	} else {
-		// No intersection.  This ray travels to infinity, so we color
-		// it according to the background color, which in this (simple) case
-		// is just black.
-		if (haveCubeMap()) {
-			CubeMap *cm = getCubeMap();
-			colorC = cm->getColor(r);
-		}else{
-			colorC = Vec3d(0.0, 0.0, 0.0);
-		}
+		colorC = background(r);
 	}
 	return colorC;
 }
 
+// No intersection.  This ray travels to infinity, so we color
+// it according to the background color, which in this (simple) case
+// is just black.
+Vec3d RayTracer::background(const ray& r)
+{
+	if (haveCubeMap()) {
+		CubeMap *cm = getCubeMap();
+		return cm->getColor(r);
+	}
+	return Vec3d(0.0, 0.0, 0.0);
+}
+
+// Aim the reflected and refracted rays for a hit.  leaving is set if r
+// was on its way out of the object.  Returns false when there is no
+// refracted ray because of total internal reflection.
+bool RayTracer::spawnRays(const ray& r, const isect& i, ray& reflect, ray& refract, bool& leaving)
+{
+	const Material& m = i.getMaterial();
+
+  	//reflection
+  	Vec3d N = i.N;
+    Vec3d L = -r.d; //opposite of ray direction
+    L.normalize();
+
+    Vec3d dirReflect = 2*max((L*N), 0.0)*N-L;
+    dirReflect.normalize();
+
+    reflect = ray(offsetRayOrigin(r.at(i.t), N, dirReflect), dirReflect, ray :: REFLECTION);
+    reflect.setCone(r.coneWidthAt(i.t), r.coneSpread);
+    reflect.setTime(r.time);
+
+
+	//refraction
+	double yita_i=1.0;// = m.index(i); //object = i
+    double yita_t=1.0;// = 1.0; //air =t
+    double yita=1.0;// = yita_i/yita_t;
+	double cosine_i = N * L;
+	double flag = 1;
+	leaving = false;
+    if(cosine_i>0){
+    	yita_i = 1.0; //air = i
+	    yita_t = m.index(i); //object =t
+	    yita = yita_i/yita_t;
+	    
+    }else{
+    	yita_i = m.index(i); //object = i
+	    yita_t = 1.0; //air =t
+	    yita = yita_i/yita_t;
+	    leaving = true;
+	    
+	    flag = -1;
+
+	    double sine_i = sqrt(1 - cosine_i*cosine_i);
+	    double sine_t = yita * sine_i;
+	    if(sine_t>1){
+	    	return false;
+	    }
+    }
+
+    double cosine_t = sqrt(1-yita*yita*(1-cosine_i*cosine_i));
+
+    Vec3d dirRefract = (yita*cosine_i - cosine_t * flag) * N  - yita * L;
+    dirRefract.normalize();
+    refract = ray(offsetRayOrigin(r.at(i.t), N, dirRefract), dirRefract, ray :: REFRACTION);
+    refract.setCone(r.coneWidthAt(i.t), r.coneSpread);
+    refract.setTime(r.time);
+    return true;
+}
+
+// Deferred shading.  Rather than following each pixel's ray tree to the
+// end before starting on the next pixel, find every primary hit first,
+// then shade one generation of rays at a time: each generation is sorted
+// by material so that consecutive shade() calls run the same code on the
+// same data, and the reflected and refracted rays it spawns are gathered
+// into the next generation and intersected together.  Each ray carries
+// the product of the kr and kt it passed through, so the pixels come out
+// as traceRay() would have them, up to rounding.
+void RayTracer::traceDeferred()
+{
+	if( ! sceneLoaded() ) return;
+
+	if( ! hitBufferValid() ) {
+		TIMELINE_SCOPE( "intersect primary rays" );
+		fillHitBuffer();
+	}
+
+	int depth = min( traceUI->getDepth(), maxDeferredDepth( buffer_width, buffer_height ) );
+	vector<Vec3d> color( rayTree[0].size(), Vec3d(0,0,0) );
+	vector<DeferredRay> next;
+	{
+		TIMELINE_SCOPE( "shade generation" );
+		shadeGeneration( rayTree[0], depth, color, next );
+	}
+	size_t g = 1;
+	for( ; ! next.empty(); ++g ) {
+		TIMELINE_SCOPE( "shade generation" );
+		if( rayTree.size() <= g ) rayTree.push_back( vector<DeferredRay>() );
+		reuseHits( rayTree[g], next );
+		rayTree[g].swap( next );
+		next.clear();
+		shadeGeneration( rayTree[g], --depth, color, next );
+	}
+	rayTree.resize( g );
+
+	for( size_t p = 0; p < color.size(); ++p ) {
+		int i = int( p % buffer_width ), j = int( p / buffer_width );
+		frame.clearPixel( i, j );
+		frame.addSample( i, j, color[p], rayTree[0][p].hit ? 1.0 : 0.0 );
+		frame.toBytes( i, j, buffer + p * 3 );
+	}
+}
+
+int RayTracer::maxDeferredDepth(int w, int h)
+{
+	// every path is below w * h * 2^depth, which has to fit in 63 bits
+	int bits = 0;
+	while( ( 1LL << bits ) < (long long) w * h ) ++bits;
+	return 63 - bits;
+}
+
+bool RayTracer::hitBufferValid() const
+{
+	return sceneLoaded() && hitBufferScene == scene->getGeneration()
+		&& hitBufferWidth == buffer_width && hitBufferHeight == buffer_height
+		&& hitBufferSmooth == traceUI->smShadSw()
+		&& hitBufferEye == scene->getCamera().getEye() && hitBufferLook == scene->getCamera().getLook()
+		&& hitBufferU == scene->getCamera().getU() && hitBufferV == scene->getCamera().getV()
+		&& ! rayTree.empty() && rayTree[0].size() == size_t( buffer_width * buffer_height );
+}
+
+void RayTracer::intersect(DeferredRay& d)
+{
+	if( costBuffer.empty() ) {
+		d.hit = scene->intersect( d.r, d.i );
+	} else {
+		double before = costMark();
+		d.hit = scene->intersect( d.r, d.i );
+		costBuffer[d.pixel] += float( costMark() - before );
+	}
+}
+
+static bool sameRay(const ray& a, const ray& b)
+{
+	return a.p == b.p && a.d == b.d
+		&& a.coneWidth == b.coneWidth && a.coneSpread == b.coneSpread;
+}
+
+// Give each of rays the hit recorded for it last frame, if it went the
+// same way then, and intersect the rest.  Both lists are in path order.
+void RayTracer::reuseHits(const vector<DeferredRay>& recorded, vector<DeferredRay>& rays)
+{
+	size_t c = 0;
+	for( size_t k = 0; k < rays.size(); ++k ) {
+		while( c < recorded.size() && recorded[c].path < rays[k].path ) ++c;
+		if( c < recorded.size() && recorded[c].path == rays[k].path
+			&& sameRay( recorded[c].r, rays[k].r ) ) {
+			rays[k].i = recorded[c].i;
+			rays[k].hit = recorded[c].hit;
+		} else {
+			intersect( rays[k] );
+		}
+	}
+}
+
+// The G-buffer: the primary ray and its hit for every pixel, in the
+// order tracePixel() visits them.  Anything recorded past it belonged to
+// another scene.
+void RayTracer::fillHitBuffer()
+{
+	rayTree.assign( 1, vector<DeferredRay>() );
+	vector<DeferredRay>& hitBuffer = rayTree[0];
+	hitBuffer.reserve( buffer_width * buffer_height );
+	for( int j = 0; j < buffer_height; ++j )
+		for( int i = 0; i < buffer_width; ++i ) {
+			double x = double(i)/double(buffer_width);
+			double y = double(j)/double(buffer_height);
+			ray r(Vec3d(0,0,0), Vec3d(0,0,0), ray::VISIBILITY);
+			scene->getCamera().rayThrough(x,y,r);
+			r.setCone(0.0, scene->getCamera().getV().length() / std::max(buffer_height, 1));
+			int p = i + j * buffer_width;
+			hitBuffer.push_back( DeferredRay( r, Vec3d(1,1,1), p, p ) );
+			intersect( hitBuffer.back() );
+		}
+	hitBufferScene = scene->getGeneration();
+	hitBufferWidth = buffer_width;
+	hitBufferHeight = buffer_height;
+	hitBufferSmooth = traceUI->smShadSw();
+	const Camera& camera = scene->getCamera();
+	hitBufferEye = camera.getEye();
+	hitBufferLook = camera.getLook();
+	hitBufferU = camera.getU();
+	hitBufferV = camera.getV();
+}
+
+// Shade one generation of rays, adding what they see to their pixels and
+// queueing the rays they spawn on next.  depth is what traceRay() would
+// have been given for these rays.
+void RayTracer::shadeGeneration(const vector<DeferredRay>& rays, int depth,
+	vector<Vec3d>& color, vector<DeferredRay>& next)
+{
+	// misses sort first, under a null material
+	vector< pair<const Material*, int> > order( rays.size() );
+	for( size_t k = 0; k < rays.size(); ++k )
+		order[k] = make_pair( rays[k].hit ? &rays[k].i.getMaterial() : (const Material*) 0, (int) k );
+	sort( order.begin(), order.end() );
+
+	// results are filed by ray rather than in shading order, so that the
+	// sums for each pixel do not depend on where materials are in memory
+	vector<Vec3d> seen( rays.size() );
+	DeferredRay none( rays.empty() ? ray(Vec3d(0,0,0), Vec3d(0,0,0)) : rays[0].r, Vec3d(0,0,0), -1, -1 );
+	vector<DeferredRay> spawned( depth > 0 ? 2 * rays.size() : 0, none );
+
+	for( size_t n = 0; n < order.size(); ++n ) {
+		int k = order[n].second;
+		const DeferredRay& d = rays[k];
+		if( ! d.hit ) {
+			seen[k] = background( d.r );
+			continue;
+		}
+		const Material& m = *order[n].first;
+		double before = costBuffer.empty() ? 0.0 : costMark();
+		if( depth <= 0 ) {
+			seen[k] = m.shade( scene, d.r, d.i );
+			if( ! costBuffer.empty() ) costBuffer[d.pixel] += float( costMark() - before );
+			continue;
+		}
+
+		ray reflect( d.r ), refract( d.r );
+		bool leaving;
+		bool refracts = spawnRays( d.r, d.i, reflect, refract, leaving );
+		seen[k] = leaving ? Vec3d(0,0,0) : m.shade( scene, d.r, d.i );
+		if( ! costBuffer.empty() ) costBuffer[d.pixel] += float( costMark() - before );
+
+		// a ray that can add nothing is not worth intersecting
+		Vec3d w = d.weight % m.kr( d.i );
+		if( ! w.iszero() ) spawned[2 * k] = DeferredRay( reflect, w, d.pixel, 2 * d.path );
+		if( refracts ) {
+			w = d.weight % m.kt( d.i );
+			if( ! w.iszero() ) spawned[2 * k + 1] = DeferredRay( refract, w, d.pixel, 2 * d.path + 1 );
+		}
+	}
+
+	for( size_t k = 0; k < rays.size(); ++k )
+		color[rays[k].pixel] += rays[k].weight % seen[k];
+	for( size_t k = 0; k < spawned.size(); ++k )
+		if( spawned[k].pixel >= 0 ) next.push_back( spawned[k] );
+}
+
 RayTracer::RayTracer()
-	: scene(0), buffer(0), buffer_width(256), buffer_height(256), m_bBufferReady(false)
+	: scene(0), buffer(0), buffer_width(256), buffer_height(256), m_bBufferReady(false),
+	  hitBufferScene(0), hitBufferWidth(0), hitBufferHeight(0), hitBufferSmooth(false),
+	  costMetric(TraceUI::NO_COST)
 {}
 
 RayTracer::~RayTracer()
@@ -189,6 +448,7 @@ bool RayTracer::loadScene( char* fn ) {
 	Tokenizer tokenizer( ifs, false );
     Parser parser( tokenizer, path );
 	try {
+		TIMELINE_SCOPE( "parse scene" );
 		delete scene;
 		scene = 0;
 		scene = parser.parseScene();
@@ -212,8 +472,11 @@ bool RayTracer::loadScene( char* fn ) {
 
 	if( !sceneLoaded() ) return false;
 
+	scene->buildLightTree();
+
 	if(graphicalUI->m_kdtreeInfo){
-		scene->buildKdTree(graphicalUI->m_nKdtreeMaxDepth, graphicalUI->m_nKdtreeLeafSize);
+		if(traceUI->bvhSw()) scene->buildBvh();
+		else scene->buildKdTree(graphicalUI->m_nKdtreeMaxDepth, graphicalUI->m_nKdtreeLeafSize);
 	}
 
 	return true;
@@ -230,6 +493,56 @@ void RayTracer::traceSetup(int w, int h)
 		buffer = new unsigned char[bufferSize];
 	}
 	memset(buffer, 0, w*h*3);
+	frame.resize(w, h);
+	costMetric = traceUI->getCostMetric();
+	if (costMetric == TraceUI::NO_COST) costBuffer.clear();
+	else costBuffer.assign(w*h, 0.0f);
 	m_bBufferReady = true;
+	if (cubeMap) cubeMap->setFilterWidth(traceUI->getFilterWidth());
 }
 
+
+// Where the cost counter stands now, in the units of the cost heatmap:
+// kd-tree nodes visited plus primitives tested, or nanoseconds.
+double RayTracer::costMark() const
+{
+	if (costMetric == TraceUI::COST_NANOSECONDS)
+		return std::chrono::duration<double, std::nano>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	return double(RenderStats::local().steps());
+}
+
+// Black for the cheapest pixels, then blue, red and yellow, to white for
+// the dearest.  v is in [0, 1].
+static Vec3d heat(double v)
+{
+	static const Vec3d stops[5] = {
+		Vec3d(0,0,0), Vec3d(0,0,1), Vec3d(1,0,0), Vec3d(1,1,0), Vec3d(1,1,1)
+	};
+	double s = v * 4.0;
+	int k = std::min(int(s), 3);
+	double f = s - k;
+	return stops[k] * (1.0 - f) + stops[k + 1] * f;
+}
+
+// The scale tops out at the 99th percentile so that a handful of very
+// expensive pixels does not leave the rest of the image black.
+void RayTracer::writeCostImage(const char* filename)
+{
+	if (costBuffer.empty()) return;
+	TIMELINE_SCOPE("write cost image");
+
+	vector<float> sorted(costBuffer);
+	size_t top = (sorted.size() - 1) * 99 / 100;
+	nth_element(sorted.begin(), sorted.begin() + top, sorted.end());
+	double scale = sorted[top] > 0 ? sorted[top] : 1.0;
+
+	vector<unsigned char> image(costBuffer.size() * 3);
+	for (size_t p = 0; p < costBuffer.size(); ++p) {
+		Vec3d c = heat(std::min(costBuffer[p] / scale, 1.0));
+		image[3 * p] = (unsigned char)(255.0 * c[0]);
+		image[3 * p + 1] = (unsigned char)(255.0 * c[1]);
+		image[3 * p + 2] = (unsigned char)(255.0 * c[2]);
+	}
+	writeBMP(filename, buffer_width, buffer_height, &image[0]);
+}
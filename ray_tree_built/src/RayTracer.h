@@ -6,27 +6,76 @@
 #include "scene/ray.h"
 #include <time.h>
 #include <queue>
+#include <vector>
 #include "scene/cubeMap.h"
+#include "scene/frameBuffer.h"
 
 class Scene;
 
+// A ray waiting to be shaded in deferred mode: where it hit, and how much
+// of what it sees reaches the pixel it started from.
+struct DeferredRay {
+	DeferredRay(const ray& rr, const Vec3d& w, int p, long long pth)
+		: r(rr), i(), hit(false), weight(w), pixel(p), path(pth) {}
+
+	ray r;
+	isect i;
+	bool hit;
+	Vec3d weight;
+	int pixel;
+	long long path;		// the pixel for a primary ray, then 2 * parent's
+				// path, plus 1 if refracted; rising within a generation.
+				// Below w * h * 2^depth, so depth is bounded by
+				// RayTracer::maxDeferredDepth()
+};
+
 class RayTracer
 {
 public:
 	RayTracer();
         ~RayTracer();
 
+	// Replaces pixel (i,j) of the frame with one sample through its
+	// corner, and returns that sample's color.  If the scene moves, it
+	// takes TraceUI::getMotionSamples() samples instead, spread over the
+	// shutter, and returns their average.
 	Vec3d tracePixel(int i, int j);
+	// Adds a sample through window coordinates (x,y) at the given time
+	// in the shutter to pixel (i,j).
+	void addSample(int i, int j, double x, double y, double time = 0.0);
 	Vec3d trace(double x, double y);
-	Vec3d traceRay(ray& r, int depth);
+	// What trace() returns, before it is clamped to [0, 1]; hit, if
+	// given, says whether the ray struck anything.
+	Vec3d radiance(double x, double y, bool* hit = 0, double time = 0.0);
+	Vec3d traceRay(ray& r, int depth, bool* hit = 0);
+	// The time in the shutter of pixel (i,j)'s k'th of n samples.
+	static double shutterTime(int i, int j, int k, int n);
 
+	// Render the whole frame with deferred shading.  Every ray's hit is
+	// kept, and while the scene, camera and image size stay the same the next call
+	// only shades again, re-intersecting just the rays that changed
+	// direction because a material did.
+	void traceDeferred();
+	bool hitBufferValid() const;
+	// The deepest ray tree traceDeferred() can number for a w x h frame
+	// without a DeferredRay::path overflowing; it traces no deeper.
+	static int maxDeferredDepth(int w, int h);
+
+	// The frame as 8-bit RGB for display, kept up to date with the frame
+	// pixel by pixel.
 	void getBuffer(unsigned char *&buf, int &w, int &h);
+	FrameBuffer& getFrame() { return frame; }
+
+	// Write what each pixel cost to trace, as measured by
+	// TraceUI::getCostMetric() during the last render, as a heatmap.
+	// Does nothing if no cost was measured.
+	void writeCostImage(const char* filename);
 	double aspectRatio();
 
 	void traceSetup( int w, int h );
 
 	bool loadScene(char* fn);
-	bool sceneLoaded() { return scene != 0; }
+	bool sceneLoaded() const { return scene != 0; }
 
 	void setReady(bool ready) { m_bBufferReady = ready; }
 	bool isReady() const { return m_bBufferReady; }
@@ -42,6 +91,7 @@ public:
     bool haveCubeMap() { return cubeMap != 0; }
 
 public:
+        FrameBuffer frame;		// what the render accumulates into
         unsigned char *buffer;
         int buffer_width, buffer_height;
         int bufferSize;
@@ -49,6 +99,29 @@ public:
         CubeMap* cubeMap = 0;
 
         bool m_bBufferReady;
+
+private:
+	Vec3d background(const ray& r);
+	bool spawnRays(const ray& r, const isect& i, ray& reflect, ray& refract, bool& leaving);
+
+	double costMark() const;
+
+	void intersect(DeferredRay& d);
+	void reuseHits(const std::vector<DeferredRay>& recorded, std::vector<DeferredRay>& rays);
+	void fillHitBuffer();
+	void shadeGeneration(const std::vector<DeferredRay>& rays, int depth,
+		std::vector<Vec3d>& color, std::vector<DeferredRay>& next);
+
+	// the rays of the last deferred frame, one generation per level of
+	// recursion; the first holds the primary hits, one per pixel
+	std::vector< std::vector<DeferredRay> > rayTree;
+	unsigned long hitBufferScene;		// Scene::getGeneration() they came from
+	int hitBufferWidth, hitBufferHeight;
+	bool hitBufferSmooth;			// smooth shading moves trimesh normals
+	Vec3d hitBufferEye, hitBufferLook, hitBufferU, hitBufferV;	// the camera
+
+	std::vector<float> costBuffer;		// per pixel, if a cost metric is on
+	int costMetric;				// TraceUI::CostMetric
 };
 
 #endif // __RAYTRACER_H__
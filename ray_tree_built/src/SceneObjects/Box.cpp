@@ -1,24 +1,25 @@
 #include <cmath>
 #include <assert.h>
 #include <algorithm>
+#include <limits>
 
 #include "Box.h"
 
 using namespace std;
 
-const double HUGE_DOUBLE = 1e100;
+const Scalar HUGE_SCALAR = std::numeric_limits<Scalar>::max();
 
 bool Box::intersectLocal(ray& r, isect& i) const
 {
-        Vec3d p = r.getPosition();
-        Vec3d d = r.getDirection();
+        Vec3s p = r.getPosition();
+        Vec3s d = r.getDirection();
 //        d.normalize();
 
         int it;
-        double x, y, t, bestT; 
+        Scalar x, y, t, bestT; 
         int mod0, mod1, mod2, bestIndex;
 
-        bestT = HUGE_DOUBLE;
+        bestT = HUGE_SCALAR;
         bestIndex = -1;
 
         for(it=0; it<6; it++){ 
@@ -54,23 +55,22 @@ bool Box::intersectLocal(ray& r, isect& i) const
         
         i.setT(bestT);
         i.setObject(this);
-		i.setMaterial(this->getMaterial());
 
 		//Vec3d intersect_point = r.at((float)i.t);
-		Vec3d intersect_point = r.at(i.t);
+		Vec3s intersect_point = r.at(i.t);
 
 		int i1 = (bestIndex + 1) % 3;
 		int i2 = (bestIndex + 2) % 3;
 
         if(bestIndex < 3)
 		{
-                i.setN(Vec3d(-double(bestIndex == 0), -double(bestIndex == 1), -double(bestIndex == 2)));
+                i.setN(Vec3d(-Scalar(bestIndex == 0), -Scalar(bestIndex == 1), -Scalar(bestIndex == 2)));
 				i.setUVCoordinates( Vec2d(	0.5 - intersect_point[ min(i1, i2) ], 
 											0.5 + intersect_point[ max(i1, i2) ] ) );
 		}
         else
 		{
-                i.setN(Vec3d(double(bestIndex==3), double(bestIndex == 4), double(bestIndex == 5)));
+                i.setN(Vec3d(Scalar(bestIndex==3), Scalar(bestIndex == 4), Scalar(bestIndex == 5)));
 				i.setUVCoordinates( Vec2d(	0.5 + intersect_point[ min(i1, i2) ],
 											0.5 + intersect_point[ max(i1, i2) ] ) );
 
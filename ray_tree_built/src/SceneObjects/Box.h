@@ -5,7 +5,7 @@
 
 class Box : public MaterialSceneObject {
 public:
-	Box( Scene *scene, Material *mat )
+	Box( Scene *scene, const Material& mat )
 		: MaterialSceneObject( scene, mat )
 	{
 	}
@@ -7,7 +7,7 @@ class Cone
 	: public MaterialSceneObject
 {
 public:
-	Cone( Scene *scene, Material *mat, 
+	Cone( Scene *scene, const Material& mat, 
 			double h = 1.0, double br = 1.0, double tr = 0.0, 
 			bool cap = false )
 		: MaterialSceneObject( scene, mat )
@@ -53,7 +53,7 @@ public:
 	bool intersectCaps( const ray& r, isect& i ) const;
 
 protected:
-	bool isGoodRoot(Vec3d root) const;
+	bool isGoodRoot(Vec3s root) const;
 	double radiusAt(double h) const;
     
 	bool capped;
@@ -8,7 +8,6 @@ using namespace std;
 bool Cylinder::intersectLocal(ray& r, isect& i) const
 {
 	i.obj = this;
-	i.setMaterial(this->getMaterial());
 
 	if( intersectCaps( r, i ) ) {
 		isect ii;
@@ -16,7 +15,6 @@ bool Cylinder::intersectLocal(ray& r, isect& i) const
 			if( ii.t < i.t ) {
 				i = ii;
 				i.obj = this;
-				i.setMaterial(this->getMaterial());
 			}
 		}
 		return true;
@@ -27,14 +25,14 @@ bool Cylinder::intersectLocal(ray& r, isect& i) const
 
 bool Cylinder::intersectBody( const ray& r, isect& i ) const
 {
-	double x0 = r.getPosition()[0];
-	double y0 = r.getPosition()[1];
-	double x1 = r.getDirection()[0];
-	double y1 = r.getDirection()[1];
+	Scalar x0 = r.getPosition()[0];
+	Scalar y0 = r.getPosition()[1];
+	Scalar x1 = r.getDirection()[0];
+	Scalar y1 = r.getDirection()[1];
 
-	double a = x1*x1+y1*y1;
-	double b = 2.0*(x0*x1 + y0*y1);
-	double c = x0*x0 + y0*y0 - 1.0;
+	Scalar a = x1*x1+y1*y1;
+	Scalar b = 2.0*(x0*x1 + y0*y1);
+	Scalar c = x0*x0 + y0*y0 - 1.0;
 
 	if( 0.0 == a ) {
 		// This implies that x1 = 0.0 and y1 = 0.0, which further
@@ -43,7 +41,7 @@ bool Cylinder::intersectBody( const ray& r, isect& i ) const
 		return false;
 	}
 
-	double discriminant = b*b - 4.0*a*c;
+	Scalar discriminant = b*b - 4.0*a*c;
 
 	if( discriminant < 0.0 ) {
 		return false;
@@ -51,18 +49,18 @@ bool Cylinder::intersectBody( const ray& r, isect& i ) const
 	
 	discriminant = sqrt( discriminant );
 
-	double t2 = (-b + discriminant) / (2.0 * a);
+	Scalar t2 = (-b + discriminant) / (2.0 * a);
 
 	if( t2 <= RAY_EPSILON ) {
 		return false;
 	}
 
-	double t1 = (-b - discriminant) / (2.0 * a);
+	Scalar t1 = (-b - discriminant) / (2.0 * a);
 
 	if( t1 > RAY_EPSILON ) {
 		// Two intersections.
-		Vec3d P = r.at( t1 );
-		double z = P[2];
+		Vec3s P = r.at( t1 );
+		Scalar z = P[2];
 		if( z >= 0.0 && z <= 1.0 ) {
 			// It's okay.
 			i.t = t1;
@@ -72,12 +70,12 @@ bool Cylinder::intersectBody( const ray& r, isect& i ) const
 		}
 	}
 
-	Vec3d P = r.at( t2 );
-	double z = P[2];
+	Vec3s P = r.at( t2 );
+	Scalar z = P[2];
 	if( z >= 0.0 && z <= 1.0 ) {
 		i.t = t2;
 
-		Vec3d normal( P[0], P[1], 0.0 );
+		Vec3s normal( P[0], P[1], 0.0 );
 		// In case we are _inside_ the _uncapped_ cone, we need to flip the normal.
 		// Essentially, the cone in this case is a double-sided surface
 		// and has _2_ normals
@@ -98,15 +96,15 @@ bool Cylinder::intersectCaps( const ray& r, isect& i ) const
 		return false;
 	}
 
-	double pz = r.getPosition()[2];
-	double dz = r.getDirection()[2];
+	Scalar pz = r.getPosition()[2];
+	Scalar dz = r.getDirection()[2];
 
 	if( 0.0 == dz ) {
 		return false;
 	}
 
-	double t1;
-	double t2;
+	Scalar t1;
+	Scalar t2;
 
 	if( dz > 0.0 ) {
 		t1 = (-pz)/dz;
@@ -121,7 +119,7 @@ bool Cylinder::intersectCaps( const ray& r, isect& i ) const
 	}
 
 	if( t1 >= RAY_EPSILON ) {
-		Vec3d p( r.at( t1 ) );
+		Vec3s p( r.at( t1 ) );
 		if( (p[0]*p[0] + p[1]*p[1]) <= 1.0 ) {
 			i.t = t1;
 			if( dz > 0.0 ) {
@@ -134,7 +132,7 @@ bool Cylinder::intersectCaps( const ray& r, isect& i ) const
 		}
 	}
 
-	Vec3d p( r.at( t2 ) );
+	Vec3s p( r.at( t2 ) );
 	if( (p[0]*p[0] + p[1]*p[1]) <= 1.0 ) {
 		i.t = t2;
 		if( dz > 0.0 ) {
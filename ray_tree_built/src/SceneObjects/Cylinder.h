@@ -7,7 +7,7 @@ class Cylinder
 	: public MaterialSceneObject
 {
 public:
-	Cylinder( Scene *scene, Material *mat )
+	Cylinder( Scene *scene, const Material& mat )
 		: MaterialSceneObject( scene, mat ), capped( true )
 	{
 	}
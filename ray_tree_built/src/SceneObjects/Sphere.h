@@ -7,7 +7,7 @@ class Sphere
 	: public MaterialSceneObject
 {
 public:
-	Sphere( Scene *scene, Material *mat )
+	Sphere( Scene *scene, const Material& mat )
 		: MaterialSceneObject( scene, mat )
 	{
 	}
@@ -8,20 +8,20 @@ using namespace std;
 //Test
 bool Square::intersectLocal(ray& r, isect& i) const
 {
-	Vec3d p = r.getPosition();
-	Vec3d d = r.getDirection();
+	Vec3s p = r.getPosition();
+	Vec3s d = r.getDirection();
 
 	if( d[2] == 0.0 ) {
 		return false;
 	}
 
-	double t = -p[2]/d[2];
+	Scalar t = -p[2]/d[2];
 
 	if( t <= RAY_EPSILON ) {
 		return false;
 	}
 
-	Vec3d P = r.at( t );
+	Vec3s P = r.at( t );
 
 	if( P[0] < -0.5 || P[0] > 0.5 ) {	
 		return false;
@@ -32,7 +32,6 @@ bool Square::intersectLocal(ray& r, isect& i) const
 	}
 
 	i.obj = this;
-	i.setMaterial(this->getMaterial());
 	i.t = t;
 	if( d[2] > 0.0 ) {
 		i.N = Vec3d( 0.0, 0.0, -1.0 );
@@ -7,7 +7,7 @@ class Square
 	: public MaterialSceneObject
 {
 public:
-	Square( Scene *scene, Material *mat )
+	Square( Scene *scene, const Material& mat )
 		: MaterialSceneObject( scene, mat )
 	{
 	}
@@ -13,19 +13,19 @@ using namespace std;
 
 Trimesh::~Trimesh()
 {
-	for( Materials::iterator i = materials.begin(); i != materials.end(); ++i )
-		delete *i;
+	// faces belong to the scene's arena, materials to its material table
+	delete kdtree;
 }
 
 // must add vertices, normals, and materials IN ORDER
-void Trimesh::addVertex( const Vec3d &v )
+void Trimesh::addVertex( const Vec3s &v )
 {
     vertices.push_back( v );
 }
 
-void Trimesh::addMaterial( Material *m )
+void Trimesh::addMaterial( const Material& m )
 {
-    materials.push_back( m );
+    materials.push_back( scene->internMaterial( m ) );
 }
 
 void Trimesh::addNormal( const Vec3d &n )
@@ -40,7 +40,8 @@ bool Trimesh::addFace( int a, int b, int c )
 
     if( a >= vcnt || b >= vcnt || c >= vcnt ) return false;
 
-    TrimeshFace *newFace = new TrimeshFace( scene, new Material(*this->material),  this, a, b, c );
+    // every face shares the mesh's entry in the scene material table
+    TrimeshFace *newFace = scene->getArena().create<TrimeshFace>( scene, materialId, this, a, b, c );
     newFace->setTransform(this->transform);
     if (!newFace->degen) faces.push_back( newFace );
 
@@ -64,8 +65,8 @@ char* Trimesh::doubleCheck()
 
 bool Trimesh::intersectLocal(ray& r, isect& i) const
 {
-	double tmin = 0.0;
-	double tmax = 0.0;
+	Scalar tmin = 0.0;
+	Scalar tmax = 0.0;
 	typedef Faces::const_iterator iter;
 	bool have_one = false;
 
@@ -95,40 +96,40 @@ bool Trimesh::intersectLocal(ray& r, isect& i) const
 bool TrimeshFace::intersectLocal(ray& r, isect& i) const
 {
 
-    const Vec3d& a = parent->vertices[ids[0]];
-    const Vec3d& b = parent->vertices[ids[1]];
-    const Vec3d& c = parent->vertices[ids[2]];
+    const Vec3s& a = parent->vertices[ids[0]];
+    const Vec3s& b = parent->vertices[ids[1]];
+    const Vec3s& c = parent->vertices[ids[2]];
 
     // YOUR CODE HERE
-    Vec3d u = b-a;
-    Vec3d v = c-a;
+    Vec3s u = b-a;
+    Vec3s v = c-a;
 
     //calculating normal
-    Vec3d n = u^v;
+    Vec3s n = u^v;
     n.normalize();
     //calculating count
-    double d = 0-(n*a);
+    Scalar d = 0-(n*a);
 
     //calculating t=-(d(num)+n(vec)*p(vec))/(n(vec)*d(vec))
-    double t = -(d+n*(r.p))/(n*(r.d));
+    Scalar t = -(d+n*(r.p))/(n*(r.d));
     if(t<RAY_EPSILON) return false;
     //calculating intersect
-    Vec3d p = r.at(t);
+    Vec3s p = r.at(t);
 
     //judge if intersect
-    Vec3d vec_ab = b-a;
-    Vec3d vec_bc = c-b;
-    Vec3d vec_ca = a-c;
+    Vec3s vec_ab = b-a;
+    Vec3s vec_bc = c-b;
+    Vec3s vec_ca = a-c;
 
-    Vec3d vec_ap = p-a;
-    Vec3d vec_bp = p-b;
-    Vec3d vec_cp = p-c;
+    Vec3s vec_ap = p-a;
+    Vec3s vec_bp = p-b;
+    Vec3s vec_cp = p-c;
 
     if((vec_ab^vec_ap) * (vec_bc^vec_bp)>=0&&
         (vec_ab^vec_ap) * (vec_ca^vec_cp)>=0&&
         (vec_bc^vec_bp) * (vec_ca^vec_cp)>=0){
 
-        double alpha, beta, gamma;
+        Scalar alpha, beta, gamma;
         alpha = (vec_bc^vec_bp).length()/(vec_ab^vec_bc).length();
         beta = (vec_ca^vec_cp).length()/(vec_ab^vec_bc).length();
         gamma = (vec_ab^vec_ap).length()/(vec_ab^vec_bc).length();
@@ -148,13 +149,11 @@ bool TrimeshFace::intersectLocal(ray& r, isect& i) const
             
         }
 
-        if(parent -> materials.empty()){
-            i.setMaterial(i.getMaterial());
-        }else{
+        if(!parent -> materials.empty()){
             Material material;
-            material += (alpha * (*(parent->materials[ids[0]])));
-            material += (beta * (*(parent->materials[ids[1]])));
-            material += (gamma * (*(parent->materials[ids[2]])));
+            material += (alpha * scene->getMaterial(parent->materials[ids[0]]));
+            material += (beta * scene->getMaterial(parent->materials[ids[1]]));
+            material += (gamma * scene->getMaterial(parent->materials[ids[2]]));
             i.setMaterial(material);
         }
 
@@ -200,7 +199,8 @@ void Trimesh::buildKdTree(){
     if(!kdTreeBuilt){
         std::vector<Geometry*> objects(faces.size());
         std::copy(faces.begin(), faces.end(), objects.begin());
-        kdtree = new KdTree(graphicalUI->m_nKdtreeMaxDepth, localBounds, graphicalUI->m_nKdtreeLeafSize);
+        // the mesh has already taken the ray into its own space
+        kdtree = new KdTree(graphicalUI->m_nKdtreeMaxDepth, localBounds, graphicalUI->m_nKdtreeLeafSize, true);
         kdtree->addObjects(objects);
         kdTreeBuilt = true;
     }
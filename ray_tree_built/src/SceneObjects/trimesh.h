@@ -14,9 +14,9 @@ class Trimesh : public MaterialSceneObject
 {
     friend class TrimeshFace;
     typedef std::vector<Vec3d> Normals;
-    typedef std::vector<Vec3d> Vertices;
+    typedef std::vector<Vec3s> Vertices;	// at geometry precision
     typedef std::vector<TrimeshFace*> Faces;
-    typedef std::vector<Material*> Materials;
+    typedef std::vector<int> Materials;    // indices into the scene's material table
 
     Vertices vertices;
     Faces faces;
@@ -25,10 +25,11 @@ class Trimesh : public MaterialSceneObject
 	BoundingBox localBounds;
 
 public:
-    Trimesh( Scene *scene, Material *mat, TransformNode *transform )
+    Trimesh( Scene *scene, const Material& mat, TransformNode *transform )
         : MaterialSceneObject(scene, mat), 
 			displayListWithMaterials(0),
-			displayListWithoutMaterials(0)
+			displayListWithoutMaterials(0),
+			kdtree(nullptr)
     {
       this->transform = transform;
       vertNorms = false;
@@ -43,8 +44,8 @@ public:
     ~Trimesh();
     
     // must add vertices, normals, and materials IN ORDER
-    void addVertex( const Vec3d & );
-    void addMaterial( Material *m );
+    void addVertex( const Vec3s & );
+    void addMaterial( const Material& m );
     void addNormal( const Vec3d & );
     bool addFace( int a, int b, int c );
 
@@ -90,8 +91,8 @@ class TrimeshFace : public MaterialSceneObject
     TransformNode *transform;
 
 public:
-    TrimeshFace( Scene *scene, Material *mat, Trimesh *parent, int a, int b, int c)
-        : MaterialSceneObject( scene, mat )
+    TrimeshFace( Scene *scene, int materialId, Trimesh *parent, int a, int b, int c)
+        : MaterialSceneObject( scene, materialId )
     {
          this->parent = parent;
         ids[0] = a;
@@ -0,0 +1,81 @@
+//
+// imgdiff.cpp
+//
+// Compares two renders of the same scene, pixel by pixel.
+//
+// usage: imgdiff [-p min_psnr] [-t tolerance] [-f max_fraction]
+//                reference.bmp test.bmp
+//
+// Either image may also be a .png or .exr as the tracer writes them, read
+// back as the bytes the same frame's .bmp would hold.
+//
+// Reports the largest channel difference, the number of pixels that differ
+// by more than tolerance steps (default 1) in any channel and the PSNR of
+// test against reference.  Exits with status 1 if the images differ in
+// size, the PSNR falls below min_psnr (30 dB by default) or more than
+// max_fraction of the pixels (default 1, no limit) differ, so a makefile
+// can use it to check one build or path of the tracer against another.
+// The PSNR bounds the overall error; the fraction catches a few badly
+// wrong pixels that would barely move it.
+//
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "../fileio/imageReader.h"
+
+int main( int argc, char** argv )
+{
+	double minPsnr = 30.0;
+	int tolerance = 1;
+	double maxFraction = 1.0;
+	int arg = 1;
+	for( ; arg + 1 < argc && argv[arg][0] == '-'; arg += 2 ) {
+		if( strcmp( argv[arg], "-p" ) == 0 ) minPsnr = atof( argv[arg + 1] );
+		else if( strcmp( argv[arg], "-t" ) == 0 ) tolerance = atoi( argv[arg + 1] );
+		else if( strcmp( argv[arg], "-f" ) == 0 ) maxFraction = atof( argv[arg + 1] );
+		else break;
+	}
+	if( argc - arg != 2 ) {
+		fprintf( stderr, "usage: %s [-p min_psnr] [-t tolerance] [-f max_fraction] reference.bmp test.bmp\n", argv[0] );
+		return 2;
+	}
+
+	int w0, h0, w1, h1;
+	unsigned char* ref = readImage( argv[arg], w0, h0 );
+	unsigned char* img = readImage( argv[arg + 1], w1, h1 );
+	if( !ref || !img ) {
+		fprintf( stderr, "%s: can't read %s\n", argv[0], ref ? argv[arg + 1] : argv[arg] );
+		return 2;
+	}
+	if( w0 != w1 || h0 != h1 ) {
+		printf( "%s: size %dx%d, expected %dx%d\n", argv[arg + 1], w1, h1, w0, h0 );
+		return 1;
+	}
+
+	int maxDiff = 0, nDiff = 0;
+	double sumSq = 0.0;
+	for( int p = 0; p < w0 * h0; ++p ) {
+		int pixelDiff = 0;
+		for( int c = 0; c < 3; ++c ) {
+			int d = abs( int( ref[p * 3 + c] ) - int( img[p * 3 + c] ) );
+			sumSq += double( d ) * d;
+			if( d > pixelDiff ) pixelDiff = d;
+		}
+		if( pixelDiff > maxDiff ) maxDiff = pixelDiff;
+		if( pixelDiff > tolerance ) ++nDiff;
+	}
+
+	double mse = sumSq / ( 3.0 * w0 * h0 );
+	double psnr = mse > 0.0 ? 10.0 * log10( 255.0 * 255.0 / mse ) : INFINITY;
+	bool ok = psnr >= minPsnr && nDiff <= maxFraction * w0 * h0;
+
+	printf( "%-36s max %3d  differing %6d/%d  psnr %6.2f dB  %s\n", argv[arg + 1],
+		maxDiff, nDiff, w0 * h0, psnr, ok ? "ok" : "FAIL" );
+
+	delete [] ref;
+	delete [] img;
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,243 @@
+//
+// isectbench.cpp
+//
+// Times the intersection kernels on their own, away from the rest of the
+// renderer: the bounding box slab tests, each primitive's intersectLocal,
+// a single trimesh face, a trimesh and a scene of spheres behind their
+// kd-trees, and Geometry::intersect on a transformed sphere, which adds the
+// world-to-object transform to the sphere test.
+//
+// usage: isectbench [iterations] [seed]
+//
+// Every kernel is run over the same two sets of rays aimed at the unit
+// cube around the origin, made from a fixed seed so runs are comparable:
+// a coherent set fanning out from one eye point in scanline order, and an
+// incoherent set with random origins and random targets.  Prints ns per
+// ray and the fraction of rays that hit for each kernel and set.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../ui/TraceUI.h"
+#include "../scene/scene.h"
+#include "../SceneObjects/Sphere.h"
+#include "../SceneObjects/Box.h"
+#include "../SceneObjects/Cylinder.h"
+#include "../SceneObjects/Cone.h"
+#include "../SceneObjects/trimesh.h"
+
+using std::vector;
+
+TraceUI* traceUI;
+
+// Trimesh faces ask traceUI whether to smooth their normals.
+class BenchUI : public TraceUI {
+public:
+	int run() { return 0; }
+	void alert( const string& msg ) { fprintf( stderr, "%s\n", msg.c_str() ); }
+};
+
+static const int N = 4096;
+
+//---[ ray sets ]------------------------------------
+
+static ray towards( const Vec3d& from, const Vec3d& to )
+{
+	Vec3d d = to - from;
+	d.normalize();
+	return ray( from, d, ray::VISIBILITY );
+}
+
+// From (0, 0, 5) through a 64 x 64 grid spanning 1.5 times the unit cube.
+static vector<ray> coherentRays()
+{
+	vector<ray> rays;
+	Vec3d eye( 0.0, 0.0, 5.0 );
+	for( int j = 0; j < 64; ++j )
+		for( int i = 0; i < 64; ++i )
+			rays.push_back( towards( eye, Vec3d( ( i + 0.5 ) / 64.0 * 3.0 - 1.5, ( j + 0.5 ) / 64.0 * 3.0 - 1.5, 0.0 ) ) );
+	return rays;
+}
+
+// From random points on a sphere of radius 5 to random points in the same
+// region, so that neighbouring rays have nothing in common.
+static vector<ray> incoherentRays( std::mt19937& rng )
+{
+	std::uniform_real_distribution<double> u( -1.0, 1.0 );
+	vector<ray> rays;
+	while( (int) rays.size() < N ) {
+		Vec3d from( u( rng ), u( rng ), u( rng ) );
+		double len = from.length();
+		if( len < 1e-3 || len > 1.0 ) continue;
+		from *= 5.0 / len;
+		rays.push_back( towards( from, Vec3d( 1.5 * u( rng ), 1.5 * u( rng ), 1.5 * u( rng ) ) ) );
+	}
+	return rays;
+}
+
+//---[ harness ]-------------------------------------
+
+static volatile int sink;
+
+// Best of five passes, in ns per ray; hits is the count from one pass.
+template <class F>
+static double timeIt( int iters, vector<ray>& rays, F f, int& hits )
+{
+	hits = 0;
+	for( size_t k = 0; k < rays.size(); ++k ) hits += f( rays[k] );
+
+	double best = 1e300;
+	for( int rep = 0; rep < 5; ++rep ) {
+		auto t0 = std::chrono::steady_clock::now();
+		int s = 0;
+		for( int i = 0; i < iters; ++i )
+			for( size_t k = 0; k < rays.size(); ++k ) s += f( rays[k] );
+		auto t1 = std::chrono::steady_clock::now();
+		sink = s;
+		double ns = std::chrono::duration<double, std::nano>( t1 - t0 ).count() / ( double( iters ) * rays.size() );
+		if( ns < best ) best = ns;
+	}
+	return best;
+}
+
+struct RaySet {
+	const char* name;
+	vector<ray> rays;
+};
+
+template <class F>
+static void run( const char* kernel, int iters, vector<RaySet>& sets, F f )
+{
+	for( size_t s = 0; s < sets.size(); ++s ) {
+		int hits;
+		double ns = timeIt( iters, sets[s].rays, f, hits );
+		printf( "%-28s %-11s %9.2f ns  hit %5.1f%%\n", kernel, sets[s].name, ns,
+			100.0 * hits / sets[s].rays.size() );
+	}
+}
+
+int main( int argc, char** argv )
+{
+	int iters = argc > 1 ? atoi( argv[1] ) : 50;
+	unsigned seed = argc > 2 ? (unsigned) atoi( argv[2] ) : 1u;
+
+	BenchUI ui;
+	traceUI = &ui;
+
+	std::mt19937 rng( seed );
+	vector<RaySet> sets( 2 );
+	sets[0].name = "coherent";
+	sets[0].rays = coherentRays();
+	sets[1].name = "incoherent";
+	sets[1].rays = incoherentRays( rng );
+
+	Scene scene;
+	Material mat;
+	TransformNode* identity = scene.transformRoot.createChild( Mat4d() );
+
+	// bounding boxes
+	BoundingBox unitBox( Vec3d( -1, -1, -1 ), Vec3d( 1, 1, 1 ) );
+	run( "BoundingBox::intersect", iters, sets, [&]( ray& r ) {
+		Scalar tMin, tMax;
+		return (int) unitBox.intersect( r, tMin, tMax );
+	} );
+
+	BoundingBox4 quad;
+	for( int lane = 0; lane < 4; ++lane ) {
+		Vec3d c( lane & 1 ? 0.5 : -0.5, lane & 2 ? 0.5 : -0.5, 0.0 );
+		quad.set( lane, BoundingBox( c - Vec3d( 0.5, 0.5, 0.5 ), c + Vec3d( 0.5, 0.5, 0.5 ) ) );
+	}
+	run( "BoundingBox4::intersect", iters, sets, [&]( ray& r ) {
+		Scalar tNear[4];
+		return quad.intersect( r, std::numeric_limits<Scalar>::max(), tNear ) != 0 ? 1 : 0;
+	} );
+
+	// primitives, in their own space
+	Sphere* sphere = scene.getArena().create<Sphere>( &scene, mat );
+	Box* box = scene.getArena().create<Box>( &scene, mat );
+	Cylinder* cylinder = scene.getArena().create<Cylinder>( &scene, mat );
+	Cone* cone = scene.getArena().create<Cone>( &scene, mat );
+	Geometry* prims[] = { sphere, box, cylinder, cone };
+	const char* primNames[] = { "Sphere::intersectLocal", "Box::intersectLocal",
+		"Cylinder::intersectLocal", "Cone::intersectLocal" };
+	for( int p = 0; p < 4; ++p ) {
+		prims[p]->setTransform( identity );
+		run( primNames[p], iters, sets, [&]( ray& r ) {
+			isect i;
+			return (int) prims[p]->intersectLocal( r, i );
+		} );
+	}
+
+	// one big triangle across the target region
+	Trimesh* tri = scene.getArena().create<Trimesh>( &scene, mat, identity );
+	tri->addVertex( Vec3s( -1.5, -1.5, 0.0 ) );
+	tri->addVertex( Vec3s( 1.5, -1.5, 0.0 ) );
+	tri->addVertex( Vec3s( 0.0, 1.5, 0.0 ) );
+	TrimeshFace* face = scene.getArena().create<TrimeshFace>( &scene, tri->getMaterialId(), tri, 0, 1, 2 );
+	run( "TrimeshFace::intersectLocal", iters, sets, [&]( ray& r ) {
+		isect i;
+		return (int) face->intersectLocal( r, i );
+	} );
+
+	// the world-to-object transform on top of the sphere test
+	TransformNode* moved = scene.transformRoot.createChild(
+		Mat4d::createTranslation( 0.2, -0.1, 0.1 ) *
+		Mat4d::createRotation( 0.7, 0.3, 1.0, 0.2 ) *
+		Mat4d::createScale( 1.2, 0.9, 1.1 ) );
+	Sphere* movedSphere = scene.getArena().create<Sphere>( &scene, mat );
+	movedSphere->setTransform( moved );
+	movedSphere->ComputeBoundingBox();
+	run( "Geometry::intersect (sphere)", iters, sets, [&]( ray& r ) {
+		isect i;
+		return (int) movedSphere->intersect( r, i );
+	} );
+
+	// a unit sphere tessellated into 80 x 40 quads, behind its own kd-tree
+	Trimesh* mesh = scene.getArena().create<Trimesh>( &scene, mat, identity );
+	const int slices = 80, stacks = 40;
+	for( int j = 0; j <= stacks; ++j )
+		for( int i = 0; i < slices; ++i ) {
+			double theta = M_PI * j / stacks, phi = 2.0 * M_PI * i / slices;
+			mesh->addVertex( Vec3s( sin( theta ) * cos( phi ), cos( theta ), sin( theta ) * sin( phi ) ) );
+		}
+	for( int j = 0; j < stacks; ++j )
+		for( int i = 0; i < slices; ++i ) {
+			int a = j * slices + i, b = j * slices + ( i + 1 ) % slices;
+			int c = a + slices, d = b + slices;
+			if( j > 0 ) mesh->addFace( a, b, d );
+			if( j < stacks - 1 ) mesh->addFace( a, d, c );
+		}
+	mesh->ComputeBoundingBox();
+	mesh->buildKdTree();
+	run( "KdTree::intersect (mesh)", iters, sets, [&]( ray& r ) {
+		isect i;
+		return (int) mesh->intersectLocal( r, i );
+	} );
+
+	// a thousand small spheres scattered over the region
+	std::uniform_real_distribution<double> u( -1.5, 1.5 ), radius( 0.03, 0.1 );
+	vector<Geometry*> balls;
+	for( int k = 0; k < 1000; ++k ) {
+		double rad = radius( rng );
+		Vec3d c( u( rng ), u( rng ), u( rng ) );
+		Sphere* s = scene.getArena().create<Sphere>( &scene, mat );
+		s->setTransform( scene.transformRoot.createChild(
+			Mat4d::createTranslation( c[0], c[1], c[2] ) * Mat4d::createScale( rad, rad, rad ) ) );
+		s->ComputeBoundingBox();
+		balls.push_back( s );
+	}
+	KdTree tree( 10, BoundingBox( Vec3d( -2, -2, -2 ), Vec3d( 2, 2, 2 ) ), 5 );
+	tree.addObjects( balls );
+	run( "KdTree::intersect (spheres)", iters / 10 + 1, sets, [&]( ray& r ) {
+		isect i;
+		return (int) tree.intersect( r, i );
+	} );
+
+	return 0;
+}
@@ -0,0 +1,49 @@
+//
+// raymerge.cpp
+//
+// Puts together a frame rendered in parts by ray -p k/n.
+//
+// usage: ray-merge output part ...
+//
+// Adds up the samples in the partial frame files and writes the result
+// as output: .png, or .exr with unclamped float color, or otherwise BMP.
+// Exits with status 1 if the parts don't load, are of different sizes,
+// or leave some pixels without a sample, as when a part is missing; the
+// image is still written in the last case, with those pixels black.
+//
+
+#include <cstdio>
+
+#include "../scene/frameBuffer.h"
+
+int main( int argc, char** argv )
+{
+	if( argc < 3 ) {
+		fprintf( stderr, "usage: %s output part ...\n", argv[0] );
+		return 2;
+	}
+
+	FrameBuffer frame;
+	for( int arg = 2; arg < argc; ++arg )
+		if( !frame.loadPartial( argv[arg] ) ) {
+			fprintf( stderr, "%s: can't load %s as part of a %dx%d frame\n", argv[0], argv[arg],
+				frame.getWidth(), frame.getHeight() );
+			return 1;
+		}
+
+	int empty = 0;
+	for( int j = 0; j < frame.getHeight(); ++j )
+		for( int i = 0; i < frame.getWidth(); ++i )
+			if( !frame.samples( i, j ) ) ++empty;
+
+	if( !frame.save( argv[1] ) ) {
+		fprintf( stderr, "%s: can't write %s\n", argv[0], argv[1] );
+		return 1;
+	}
+	if( empty ) {
+		fprintf( stderr, "%s: %d of %d pixels have no samples; is a part missing?\n", argv[0],
+			empty, frame.getWidth() * frame.getHeight() );
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,159 @@
+//
+// refitcheck.cpp
+//
+// Checks the BVH against the brute-force loop over every object, as ray -B
+// against ray -b, while the objects move: a scene of small spheres, each
+// on its own transform node, is moved with setLocalTransform() and brought
+// up to date with Scene::updateTransforms().
+//
+// usage: refitcheck [seed]
+//
+// Small steps must only refit the tree, and one move that throws every
+// sphere across the scene must make updateTransforms() build it again.
+// After the build and after every move the nearest hit of each of a set
+// of seeded rays has to be the same object at the same t both ways.
+// Exits with status 1 if any of that fails.
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "../ui/TraceUI.h"
+#include "../ui/GraphicalUI.h"
+#include "../scene/scene.h"
+#include "../SceneObjects/Sphere.h"
+
+using std::max;
+using std::vector;
+
+TraceUI* traceUI;
+
+class CheckUI : public TraceUI {
+public:
+	int run() { return 0; }
+	void alert( const string& msg ) { fprintf( stderr, "%s\n", msg.c_str() ); }
+};
+
+static const int SPHERES = 2000;
+static const int RAYS = 4096;
+static const double RADIUS = 0.05;
+static const double SMALL_STEP = 0.005;	// per axis, per move
+static const int SMALL_MOVES = 8;
+
+struct Ball {
+	TransformNode* node;
+	Vec3d center;
+};
+
+static void place( Ball& b, const Vec3d& c )
+{
+	b.center = c;
+	b.node->setLocalTransform( Mat4d::createTranslation( c[0], c[1], c[2] )
+		* Mat4d::createScale( RADIUS, RADIUS, RADIUS ) );
+}
+
+// Rays that hit the scene at different depths in the BVH's objects: from
+// random points on a sphere of radius 5 to random points inside.
+static vector<ray> makeRays( std::mt19937& rng )
+{
+	std::uniform_real_distribution<double> u( -1.0, 1.0 );
+	vector<ray> rays;
+	while( (int) rays.size() < RAYS ) {
+		Vec3d from( u( rng ), u( rng ), u( rng ) );
+		double len = from.length();
+		if( len < 1e-3 || len > 1.0 ) continue;
+		from *= 5.0 / len;
+		Vec3d d = Vec3d( 1.5 * u( rng ), 1.5 * u( rng ), 1.5 * u( rng ) ) - from;
+		d.normalize();
+		rays.push_back( ray( from, d, ray::VISIBILITY ) );
+	}
+	return rays;
+}
+
+// How many rays the BVH gets wrong, taking the loop over every object as
+// the reference.
+static int countWrong( const Scene& scene, const vector<ray>& rays )
+{
+	int wrong = 0;
+	for( size_t k = 0; k < rays.size(); ++k ) {
+		ray r0( rays[k] ), r1( rays[k] );
+		isect ref, got;
+		GraphicalUI::m_kdtreeInfo = false;
+		bool hitRef = scene.intersect( r0, ref );
+		GraphicalUI::m_kdtreeInfo = true;
+		bool hitGot = scene.intersect( r1, got );
+		if( hitRef != hitGot || ( hitRef && ( ref.obj != got.obj || ref.t != got.t ) ) ) ++wrong;
+	}
+	return wrong;
+}
+
+// moves updates, of which rebuilt built the tree again where every one or
+// none of them should have, and wrong rays out of those checked after each
+static bool report( const char* step, int moves, int rebuilt, bool expectBuild, int wrong )
+{
+	bool ok = rebuilt == ( expectBuild ? moves : 0 ) && wrong == 0;
+	printf( "%-26s built %d of %d updates  wrong %d/%d  %s\n", step, rebuilt, moves,
+		wrong, RAYS * max( moves, 1 ), ok ? "ok" : "FAIL" );
+	return ok;
+}
+
+int main( int argc, char** argv )
+{
+	unsigned seed = argc > 1 ? (unsigned) atoi( argv[1] ) : 1u;
+
+	CheckUI ui;
+	traceUI = &ui;
+
+	std::mt19937 rng( seed );
+	std::uniform_real_distribution<double> u( -1.5, 1.5 ), step( -SMALL_STEP, SMALL_STEP );
+
+	Scene scene;
+	Material mat;
+	vector<Ball> balls( SPHERES );
+	for( int k = 0; k < SPHERES; ++k ) {
+		balls[k].node = scene.transformRoot.createChild( Mat4d() );
+		place( balls[k], Vec3d( u( rng ), u( rng ), u( rng ) ) );
+		Sphere* s = scene.getArena().create<Sphere>( &scene, mat );
+		s->setTransform( balls[k].node );
+		scene.add( s );
+	}
+	scene.buildBvh();
+	vector<ray> rays = makeRays( rng );
+
+	bool ok = report( "built", 0, 0, false, countWrong( scene, rays ) );
+
+	// drift a little at a time: each refit stays well within the growth
+	// allowed, so none of them should build
+	int rebuilt = 0, wrong = 0;
+	for( int m = 0; m < SMALL_MOVES; ++m ) {
+		for( int k = 0; k < SPHERES; ++k )
+			place( balls[k], balls[k].center + Vec3d( step( rng ), step( rng ), step( rng ) ) );
+		rebuilt += scene.updateTransforms();
+		wrong += countWrong( scene, rays );
+	}
+	ok = report( "small moves", SMALL_MOVES, rebuilt, false, wrong ) && ok;
+
+	// every sphere to where another one was: refitting would leave each
+	// leaf's box spanning most of the scene
+	vector<Vec3d> centers( SPHERES );
+	for( int k = 0; k < SPHERES; ++k ) centers[k] = balls[k].center;
+	std::shuffle( centers.begin(), centers.end(), rng );
+	for( int k = 0; k < SPHERES; ++k ) place( balls[k], centers[k] );
+	rebuilt = scene.updateTransforms();
+	ok = report( "scattered", 1, rebuilt, true, countWrong( scene, rays ) ) && ok;
+
+	// and small steps from the new tree are only refits again
+	rebuilt = wrong = 0;
+	for( int m = 0; m < SMALL_MOVES; ++m ) {
+		for( int k = 0; k < SPHERES; ++k )
+			place( balls[k], balls[k].center + Vec3d( step( rng ), step( rng ), step( rng ) ) );
+		rebuilt += scene.updateTransforms();
+		wrong += countWrong( scene, rays );
+	}
+	ok = report( "small moves after that", SMALL_MOVES, rebuilt, false, wrong ) && ok;
+
+	return ok ? 0 : 1;
+}
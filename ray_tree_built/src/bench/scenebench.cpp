@@ -0,0 +1,209 @@
+//
+// scenebench.cpp
+//
+// Renders scenes headlessly at a fixed set of sizes and depths, with and
+// without the kd-tree, several times each, and reports how long it took.
+//
+// usage: scenebench [-w widths] [-r depths] [-n runs] [-f csv|json] [-H]
+//                   scene.ray ...
+//
+// widths and depths are comma-separated lists (default 100,200 and 0,3);
+// each combination is rendered runs times (default 3).  Prints one row per
+// scene, kd-tree setting, width and depth: the median and fastest render
+// time, rays traced per second, median time to parse the scene and build
+// the kd-tree, and the peak resident set size of the process so far.
+// csv rows are preceded by a header if -H is given, which also prints the
+// header alone when there are no scenes; json rows are one object per line.
+// Run one process per scene to make the peak RSS that scene's alone.
+//
+
+#include <sys/resource.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../RayTracer.h"
+#include "../ui/TraceUI.h"
+#include "../ui/GraphicalUI.h"
+#include "../scene/scene.h"
+#include "../scene/renderStats.h"
+
+using namespace std;
+
+TraceUI* traceUI;
+
+// The tracer reads its settings from traceUI; this one is set from here.
+class BenchUI : public TraceUI {
+public:
+	int run() { return 0; }
+	void alert( const string& msg ) { fprintf( stderr, "%s\n", msg.c_str() ); }
+	void setDepth( int depth ) { m_nDepth = depth; }
+};
+
+static double now()
+{
+	return chrono::duration<double>( chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+static double median( vector<double> v )
+{
+	sort( v.begin(), v.end() );
+	size_t n = v.size();
+	return n % 2 ? v[n / 2] : 0.5 * ( v[n / 2 - 1] + v[n / 2] );
+}
+
+static long peakRssKb()
+{
+	struct rusage usage;
+	getrusage( RUSAGE_SELF, &usage );
+	return usage.ru_maxrss;		// kilobytes on Linux
+}
+
+static vector<int> parseList( const char* s )
+{
+	vector<int> v;
+	for( const char* p = s; *p; ) {
+		v.push_back( atoi( p ) );
+		p = strchr( p, ',' );
+		if( !p ) break;
+		++p;
+	}
+	return v;
+}
+
+// "dir/dragon1.ray" -> "dragon1"
+static string sceneName( const string& path )
+{
+	size_t slash = path.find_last_of( "\\/" );
+	string name = slash == string::npos ? path : path.substr( slash + 1 );
+	size_t dot = name.find_last_of( '.' );
+	return dot == string::npos ? name : name.substr( 0, dot );
+}
+
+struct Result {
+	string scene;
+	bool kdtree;
+	int width, height, depth, runs;
+	double parseMs, buildMs, medianMs, minMs;
+	unsigned long long rays;
+	long peakRss;
+};
+
+static void printRow( const Result& r, bool json )
+{
+	double mrays = r.medianMs > 0 ? r.rays / ( r.medianMs * 1000.0 ) : 0.0;
+	if( json ) {
+		printf( "{\"scene\": \"%s\", \"kdtree\": %s, \"width\": %d, \"height\": %d, "
+			"\"depth\": %d, \"runs\": %d, \"parse_ms\": %.3f, \"build_ms\": %.3f, "
+			"\"median_ms\": %.3f, \"min_ms\": %.3f, \"rays\": %llu, "
+			"\"mrays_per_s\": %.3f, \"peak_rss_kb\": %ld}\n",
+			r.scene.c_str(), r.kdtree ? "true" : "false", r.width, r.height,
+			r.depth, r.runs, r.parseMs, r.buildMs, r.medianMs, r.minMs, r.rays,
+			mrays, r.peakRss );
+	} else {
+		printf( "%s,%d,%d,%d,%d,%d,%.3f,%.3f,%.3f,%.3f,%llu,%.3f,%ld\n",
+			r.scene.c_str(), r.kdtree ? 1 : 0, r.width, r.height, r.depth, r.runs,
+			r.parseMs, r.buildMs, r.medianMs, r.minMs, r.rays, mrays, r.peakRss );
+	}
+	fflush( stdout );
+}
+
+// Load the scene runs times, returning the median parse and kd-tree build
+// times; the tracer keeps the last copy.
+static bool load( RayTracer& tracer, const char* file, bool kdtree, int runs,
+	double& parseMs, double& buildMs )
+{
+	vector<double> parse, build;
+	for( int k = 0; k < runs; ++k ) {
+		// the tree is built here rather than by loadScene, to time it apart
+		GraphicalUI::m_kdtreeInfo = false;
+		double t0 = now();
+		if( !tracer.loadScene( const_cast<char*>( file ) ) ) return false;
+		double t1 = now();
+		GraphicalUI::m_kdtreeInfo = kdtree;
+		if( kdtree )
+			tracer.scene->buildKdTree( GraphicalUI::m_nKdtreeMaxDepth, GraphicalUI::m_nKdtreeLeafSize );
+		double t2 = now();
+		parse.push_back( ( t1 - t0 ) * 1000.0 );
+		build.push_back( ( t2 - t1 ) * 1000.0 );
+	}
+	parseMs = median( parse );
+	buildMs = median( build );
+	return true;
+}
+
+int main( int argc, char** argv )
+{
+	vector<int> widths = parseList( "100,200" );
+	vector<int> depths = parseList( "0,3" );
+	int runs = 3;
+	bool json = false, header = false;
+
+	int arg = 1;
+	for( ; arg < argc && argv[arg][0] == '-'; ++arg ) {
+		bool hasValue = arg + 1 < argc;
+		if( strcmp( argv[arg], "-w" ) == 0 && hasValue ) widths = parseList( argv[++arg] );
+		else if( strcmp( argv[arg], "-r" ) == 0 && hasValue ) depths = parseList( argv[++arg] );
+		else if( strcmp( argv[arg], "-n" ) == 0 && hasValue ) runs = max( 1, atoi( argv[++arg] ) );
+		else if( strcmp( argv[arg], "-f" ) == 0 && hasValue ) json = strcmp( argv[++arg], "json" ) == 0;
+		else if( strcmp( argv[arg], "-H" ) == 0 ) header = true;
+		else {
+			fprintf( stderr, "usage: %s [-w widths] [-r depths] [-n runs] [-f csv|json] [-H] scene.ray ...\n", argv[0] );
+			return 2;
+		}
+	}
+
+	if( header && !json )
+		printf( "scene,kdtree,width,height,depth,runs,parse_ms,build_ms,median_ms,min_ms,rays,mrays_per_s,peak_rss_kb\n" );
+
+	BenchUI ui;
+	traceUI = &ui;
+
+	int status = 0;
+	for( ; arg < argc; ++arg ) {
+		for( int kd = 0; kd < 2; ++kd ) {
+			RayTracer tracer;
+			ui.setRayTracer( &tracer );
+
+			Result r;
+			r.scene = sceneName( argv[arg] );
+			r.kdtree = kd != 0;
+			r.runs = runs;
+			if( !load( tracer, argv[arg], r.kdtree, runs, r.parseMs, r.buildMs ) ) {
+				fprintf( stderr, "%s: can't load %s\n", argv[0], argv[arg] );
+				status = 1;
+				break;
+			}
+
+			for( size_t d = 0; d < depths.size(); ++d )
+				for( size_t w = 0; w < widths.size(); ++w ) {
+					ui.setDepth( depths[d] );
+					r.depth = depths[d];
+					r.width = widths[w];
+					r.height = (int)( r.width / tracer.aspectRatio() + 0.5 );
+
+					vector<double> times;
+					for( int k = 0; k < runs; ++k ) {
+						tracer.traceSetup( r.width, r.height );
+						RenderStats::reset();
+						double t0 = now();
+						for( int j = 0; j < r.height; ++j )
+							for( int i = 0; i < r.width; ++i )
+								tracer.tracePixel( i, j );
+						times.push_back( ( now() - t0 ) * 1000.0 );
+					}
+					RayCounters c = RenderStats::summary();
+					r.rays = c.rays[0] + c.rays[1] + c.rays[2] + c.rays[3];
+					r.medianMs = median( times );
+					r.minMs = *min_element( times.begin(), times.end() );
+					r.peakRss = peakRssKb();
+					printRow( r, json );
+				}
+		}
+	}
+	return status;
+}
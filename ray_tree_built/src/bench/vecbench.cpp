@@ -0,0 +1,255 @@
+//
+// vecbench.cpp
+//
+// Times the vector patterns that dominate a render -- the phong light loop
+// in Material::shade, the edge tests in TrimeshFace::intersectLocal and the
+// min/max sweep used to grow bounding boxes -- once with the vec.h Vec3d and
+// once with the packed types from simd.h, on identical inputs; then the
+// kd-tree leaf's slab test, four BoundingBox::intersect calls against one
+// BoundingBox4::intersect.
+//
+// usage: vecbench [iterations]
+//
+// Prints the median ns per operation over REPS passes for each variant.
+// The packed 3-vectors are there for comparison only: they do not beat
+// vec.h reliably, so the tracer does not use them.  The packed slab test
+// is what the tracer uses, and vecbench exits with status 1 if it is
+// slower than the four scalar tests by more than the margin, widened to
+// the spread the passes themselves show, so it can be run as a
+// regression check after touching simd.h or bbox.h.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../vecmath/vec.h"
+#include "../vecmath/simd.h"
+#include "../scene/ray.h"
+#include "../scene/bbox.h"
+
+using std::vector;
+
+// a regression is the packed slab test slower than this fraction of scalar
+// speed, or than three times the passes' own relative spread if that is more
+static const double REGRESSION_MARGIN = 0.10;
+static const double NOISE_FACTOR = 3.0;
+
+static const int N = 4096;
+static const int REPS = 11;
+
+//---[ adapters so one kernel can be written for every vector type ]---
+
+static inline Vec3d unit( Vec3d v ) { v.normalize(); return v; }
+static inline double len( const Vec3d& v ) { return v.length(); }
+static inline Vec3d vmin( const Vec3d& a, const Vec3d& b ) { return minimum( a, b ); }
+static inline Vec3d vmax( const Vec3d& a, const Vec3d& b ) { return maximum( a, b ); }
+
+template <class V> static inline V unit( V v ) { return simd::normalize( v ); }
+template <class V> static inline auto len( V v ) -> decltype( simd::length( v ) ) { return simd::length( v ); }
+template <class V> static inline V vmin( V a, V b ) { return simd::minimum( a, b ); }
+template <class V> static inline V vmax( V a, V b ) { return simd::maximum( a, b ); }
+
+template <class V> static inline double first( const V& v ) { return v[0] + v[1] + v[2]; }
+
+//---[ kernels ]-------------------------------------
+
+// Material::shade, one light: diffuse + specular with a componentwise tint
+template <class V, class S>
+static double phong( const vector<V>& N, const vector<V>& L, const vector<V>& D, V kd, V ks, V col )
+{
+	V acc = V( col - col );
+	for( size_t k = 0; k < N.size(); ++k ) {
+		V n = N[k];
+		V l = unit( L[k] );
+		V v = unit( D[k] );
+		S nl = n * l;
+		if( nl < 0 ) nl = 0;
+		V r = unit( (2 * nl) * n - l );
+		S vr = -( v * r );
+		if( vr < 0 ) vr = 0;
+		S spec = vr * vr; spec *= spec; spec *= spec;		// pow( vr, 8 )
+		acc = acc + col % ( kd * nl + ks * spec );
+	}
+	return first( acc );
+}
+
+// TrimeshFace::intersectLocal: plane hit plus the three edge/cross tests
+template <class V, class S>
+static double triangle( const vector<V>& A, const vector<V>& B, const vector<V>& C,
+	const vector<V>& P, const vector<V>& D )
+{
+	double hits = 0;
+	for( size_t k = 0; k < A.size(); ++k ) {
+		V a = A[k], b = B[k], c = C[k];
+		V ab = b - a, bc = c - b, ca = a - c;
+		V n = unit( ab ^ ( c - a ) );
+		S t = ( n * a - n * P[k] ) / ( n * D[k] );
+		V p = P[k] + D[k] * t;
+		V e0 = ab ^ ( p - a ), e1 = bc ^ ( p - b ), e2 = ca ^ ( p - c );
+		if( e0 * e1 >= 0 && e0 * e2 >= 0 && e1 * e2 >= 0 ) {
+			S area = len( ab ^ bc );
+			hits += len( e1 ) / area + t;
+		}
+	}
+	return hits;
+}
+
+// BoundingBox growth over a vertex list
+template <class V>
+static double bounds( const vector<V>& P )
+{
+	V lo = P[0], hi = P[0];
+	for( size_t k = 1; k < P.size(); ++k ) {
+		lo = vmin( lo, P[k] );
+		hi = vmax( hi, P[k] );
+	}
+	return first( hi - lo );
+}
+
+// The slab tests of a kd-tree leaf: each ray against four boxes, one at
+// a time or all at once.
+static double slabs( const vector<ray>& rays, const BoundingBox box[4] )
+{
+	double hits = 0;
+	for( size_t k = 0; k < rays.size(); ++k )
+		for( int lane = 0; lane < 4; ++lane ) {
+			Scalar tMin, tMax;
+			if( box[lane].intersect( rays[k], tMin, tMax ) ) hits += tMin;
+		}
+	return hits;
+}
+
+static double slabs4( const vector<ray>& rays, const BoundingBox4& quad )
+{
+	double hits = 0;
+	for( size_t k = 0; k < rays.size(); ++k ) {
+		Scalar tNear[4];
+		int mask = quad.intersect( rays[k], std::numeric_limits<Scalar>::max(), tNear );
+		for( int lane = 0; lane < 4; ++lane )
+			if( mask & ( 1 << lane ) ) hits += tNear[lane];
+	}
+	return hits;
+}
+
+//---[ harness ]-------------------------------------
+
+static volatile double sink;
+
+// The median of REPS passes, and how far apart the middle half of them
+// lie, as a fraction of the median.
+struct Timing {
+	double ns;
+	double spread;
+};
+
+template <class F>
+static Timing timeIt( int iters, F f )
+{
+	vector<double> passes;
+	for( int rep = 0; rep < REPS; ++rep ) {
+		auto t0 = std::chrono::steady_clock::now();
+		double s = 0;
+		for( int i = 0; i < iters; ++i ) s += f();
+		auto t1 = std::chrono::steady_clock::now();
+		sink = s;
+		passes.push_back( std::chrono::duration<double, std::nano>( t1 - t0 ).count() / ( double( iters ) * N ) );
+	}
+	std::sort( passes.begin(), passes.end() );
+	Timing t;
+	t.ns = passes[REPS / 2];
+	t.spread = ( passes[3 * REPS / 4] - passes[REPS / 4] ) / t.ns;
+	return t;
+}
+
+static double frand() { return rand() / double( RAND_MAX ) * 2.0 - 1.0; }
+
+template <class V> static V conv( const Vec3d& v );
+template <> Vec3d conv<Vec3d>( const Vec3d& v ) { return v; }
+template <> simd::Vec3d conv<simd::Vec3d>( const Vec3d& v ) { return simd::load( v ); }
+template <> simd::Vec3f conv<simd::Vec3f>( const Vec3d& v )
+	{ return simd::Vec3f::make( float( v[0] ), float( v[1] ), float( v[2] ) ); }
+
+struct Inputs {
+	vector<Vec3d> n, l, d, a, b, c, p;
+};
+
+template <class V>
+static vector<V> convAll( const vector<Vec3d>& in )
+{
+	vector<V> out( in.size() );
+	for( size_t k = 0; k < in.size(); ++k ) out[k] = conv<V>( in[k] );
+	return out;
+}
+
+template <class V, class S>
+static void runAll( const Inputs& in, int iters, Timing ns[3] )
+{
+	vector<V> n = convAll<V>( in.n ), l = convAll<V>( in.l ), d = convAll<V>( in.d );
+	vector<V> a = convAll<V>( in.a ), b = convAll<V>( in.b ), c = convAll<V>( in.c ), p = convAll<V>( in.p );
+	V kd = conv<V>( Vec3d( 0.7, 0.5, 0.3 ) ), ks = conv<V>( Vec3d( 0.2, 0.2, 0.2 ) );
+	V col = conv<V>( Vec3d( 1.0, 0.9, 0.8 ) );
+
+	ns[0] = timeIt( iters, [&]() { return phong<V, S>( n, l, d, kd, ks, col ); } );
+	ns[1] = timeIt( iters, [&]() { return triangle<V, S>( a, b, c, p, d ); } );
+	ns[2] = timeIt( iters, [&]() { return bounds<V>( p ); } );
+}
+
+int main( int argc, char** argv )
+{
+	int iters = argc > 1 ? atoi( argv[1] ) : 200;
+	if( iters < 1 ) iters = 1;
+
+	srand( 1 );
+	Inputs in;
+	for( int k = 0; k < N; ++k ) {
+		Vec3d nn( frand(), frand(), frand() ); nn.normalize();
+		in.n.push_back( nn );
+		in.l.push_back( Vec3d( frand(), frand(), frand() ) );
+		in.d.push_back( Vec3d( frand(), frand(), -1.0 ) );
+		in.a.push_back( Vec3d( frand(), frand(), -2.0 ) );
+		in.b.push_back( Vec3d( frand(), frand(), -2.5 ) );
+		in.c.push_back( Vec3d( frand(), frand(), -3.0 ) );
+		in.p.push_back( Vec3d( frand() * 0.1, frand() * 0.1, 0.0 ) );
+	}
+
+	Timing scalar[3], packedD[3], packedF[3];
+	runAll<Vec3d, double>( in, iters, scalar );
+	runAll<simd::Vec3d, double>( in, iters, packedD );
+	runAll<simd::Vec3f, float>( in, iters, packedF );
+
+	const char* names[3] = { "phong", "triangle", "bounds" };
+	printf( "%-10s %12s %12s %12s %9s\n", "pattern", "Vec3d ns", "simd::Vec3d", "simd::Vec3f", "speedup" );
+	for( int k = 0; k < 3; ++k )
+		printf( "%-10s %12.2f %12.2f %12.2f %8.2fx\n", names[k],
+			scalar[k].ns, packedD[k].ns, packedF[k].ns, scalar[k].ns / packedD[k].ns );
+
+	// four boxes around the rays' targets, from the same inputs
+	vector<ray> rays;
+	for( int k = 0; k < N; ++k ) {
+		Vec3d d = in.d[k];
+		d.normalize();
+		rays.push_back( ray( in.p[k], d, ray::VISIBILITY ) );
+	}
+	BoundingBox box[4];
+	BoundingBox4 quad;
+	for( int lane = 0; lane < 4; ++lane ) {
+		Vec3d c( lane & 1 ? 0.3 : -0.3, lane & 2 ? 0.3 : -0.3, -2.0 - 0.2 * lane );
+		box[lane] = BoundingBox( c - Vec3d( 0.4, 0.4, 0.4 ), c + Vec3d( 0.4, 0.4, 0.4 ) );
+		quad.set( lane, box[lane] );
+	}
+	Timing one = timeIt( iters, [&]() { return slabs( rays, box ); } );
+	Timing four = timeIt( iters, [&]() { return slabs4( rays, quad ); } );
+	printf( "\n%-10s %12s %12s %9s\n", "pattern", "BoundingBox", "BoundingBox4", "speedup" );
+	printf( "%-10s %12.2f %12.2f %8.2fx\n", "slabs", one.ns, four.ns, one.ns / four.ns );
+
+	double margin = std::max( REGRESSION_MARGIN, NOISE_FACTOR * std::max( one.spread, four.spread ) );
+	if( four.ns > one.ns * ( 1.0 + margin ) ) {
+		printf( "REGRESSION: BoundingBox4 slower than four BoundingBox tests (margin %.0f%%)\n", 100.0 * margin );
+		return 1;
+	}
+	return 0;
+}
@@ -14,14 +14,10 @@
 BMP_BITMAPFILEHEADER bmfh; 
 BMP_BITMAPINFOHEADER bmih; 
 
-unsigned char *readBMP(const char *fname, int& width, int& height)
-{ 
-	FILE* file; 
-	BMP_DWORD pos; 
- 
-	if ( (file=fopen( fname, "rb" )) == NULL )  
-		return NULL; 
-	 
+// Read and check both headers.  The reading side keeps them on the stack
+// so that textures can be decoded on several threads at once.
+static bool readBMPHeaders( FILE* file, BMP_BITMAPFILEHEADER& bmfh, BMP_BITMAPINFOHEADER& bmih )
+{
 //	I am doing fread( &bmfh, sizeof(BMP_BITMAPFILEHEADER), 1, file ) in a safe way. :}
 	fread( &(bmfh.bfType), 2, 1, file); 
 	fread( &(bmfh.bfSize), 4, 1, file); 
@@ -29,22 +25,54 @@ unsigned char *readBMP(const char *fname, int& width, int& height)
 	fread( &(bmfh.bfReserved2), 2, 1, file); 
 	fread( &(bmfh.bfOffBits), 4, 1, file); 
 
-	pos = bmfh.bfOffBits; 
- 
-	fread( &bmih, sizeof(BMP_BITMAPINFOHEADER), 1, file ); 
+	if ( fread( &bmih, sizeof(BMP_BITMAPINFOHEADER), 1, file ) != 1 )
+		return false;
  
 	// error checking
 	if ( bmfh.bfType!= 0x4d42 ) {	// "BM" actually
-		return NULL;
+		return false;
 	}
 	if ( bmih.biBitCount != 24 )  
-		return NULL; 
+		return false; 
 /*
  	if ( bmih.biCompression != BMP_BI_RGB ) {
-		return NULL;
+		return false;
 	}
 */
-	fseek( file, pos, SEEK_SET ); 
+	return true;
+}
+
+bool readBMPSize(const char *fname, int& width, int& height)
+{
+	FILE* file;
+	BMP_BITMAPFILEHEADER bmfh;
+	BMP_BITMAPINFOHEADER bmih;
+
+	if ( (file=fopen( fname, "rb" )) == NULL )  
+		return false; 
+	bool ok = readBMPHeaders( file, bmfh, bmih );
+	fclose( file );
+	if ( !ok ) return false;
+	width = bmih.biWidth;
+	height = bmih.biHeight;
+	return true;
+}
+
+unsigned char *readBMP(const char *fname, int& width, int& height)
+{ 
+	FILE* file; 
+	BMP_BITMAPFILEHEADER bmfh;
+	BMP_BITMAPINFOHEADER bmih;
+ 
+	if ( (file=fopen( fname, "rb" )) == NULL )  
+		return NULL; 
+	 
+	if ( !readBMPHeaders( file, bmfh, bmih ) ) {
+		fclose( file );
+		return NULL;
+	}
+
+	fseek( file, bmfh.bfOffBits, SEEK_SET ); 
  
 	width = bmih.biWidth; 
 	height = bmih.biHeight; 
@@ -64,6 +92,7 @@ unsigned char *readBMP(const char *fname, int& width, int& height)
 	
 	if (!foo) {
 		delete [] data;
+		fclose( file );
 		return NULL;
 	}
 
@@ -72,7 +101,7 @@ unsigned char *readBMP(const char *fname, int& width, int& height)
 	// shuffle bitmap data such that it is (R,G,B) tuples in row-major order
 	int i, j;
 	j = 0;
-	unsigned char temp;
+	unsigned char r, g, b;
 	unsigned char* in;
 	unsigned char* out;
 
@@ -83,10 +112,14 @@ unsigned char *readBMP(const char *fname, int& width, int& height)
 	{
 		for ( i = 0; i < width; ++i )
 		{
-			out[1] = in[1];
-			temp = in[2];
-			out[2] = in[0];
-			out[0] = temp;
+			// out trails in by the padding of the rows before, so
+			// read the whole pixel before writing any of it
+			b = in[0];
+			g = in[1];
+			r = in[2];
+			out[0] = r;
+			out[1] = g;
+			out[2] = b;
 
 			in += 3;
 			out += 3;
@@ -152,4 +185,4 @@ void writeBMP(const char *iname, int width, int height, unsigned char *data)
 	delete [] scanline;
 
 	fclose(foo);
-} 
\ No newline at end of file
+} 
\ No newline at end of file
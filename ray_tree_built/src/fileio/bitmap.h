@@ -41,6 +41,7 @@ typedef struct {
 
 // global I/O routines
 extern unsigned char *readBMP(const char *fname, int& width, int& height);
+extern bool readBMPSize(const char *fname, int& width, int& height);
 extern void writeBMP(const char *iname, int width, int height, unsigned char *data); 
 
 #endif
@@ -0,0 +1,182 @@
+#include "imageReader.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "bitmap.h"
+#include "pngimage.h"
+
+using namespace std;
+
+static bool hasExtension( const char* filename, const char* ext )
+{
+	const char* dot = strrchr( filename, '.' );
+	if( !dot || strpbrk( dot, "\\/" ) ) return false;
+	string e( dot + 1 );
+	for( size_t k = 0; k < e.size(); ++k ) e[k] = (char) tolower( e[k] );
+	return e == ext;
+}
+
+//---[ PNG ]-----------------------------------------
+
+static unsigned char* readPng( const char* filename, int& width, int& height )
+{
+	int w, h, channels, rowBytes;
+	unsigned char* rows = png_read_file( filename, 2.2, 1, w, h, channels, rowBytes );
+	if( !rows ) return 0;
+	if( channels < 3 ) {
+		free( rows );
+		return 0;
+	}
+	// drop the alpha of an RGBA file
+	unsigned char* data = new unsigned char [3 * size_t( w ) * h];
+	for( int j = 0; j < h; ++j )
+		for( int i = 0; i < w; ++i )
+			memcpy( &data[3 * ( size_t( j ) * w + i )], &rows[size_t( j ) * rowBytes + i * channels], 3 );
+	free( rows );
+	width = w;
+	height = h;
+	return data;
+}
+
+//---[ EXR ]-----------------------------------------
+
+/*
+  Only the scanline files ExrWriter produces are understood: a single
+  part with FLOAT B, G and R channels, uncompressed or deflated one row
+  (ZIPS) or 16 rows (ZIP) to a chunk.  Anything else is refused rather
+  than guessed at.
+*/
+class ExrReader {
+public:
+	ExrReader( FILE* f ) : file( f ), ok( true ) {}
+
+	unsigned char* read( int& width, int& height )
+	{
+		if( get32() != 20000630 || ( get32() & 0xff ) != 2 ) return 0;
+
+		int compression = -1, lineOrder = 0;
+		int x0 = 0, y0 = 0, x1 = -1, y1 = -1;
+		string channels;
+		for( string name = getString(); ok && !name.empty(); name = getString() ) {
+			string type = getString();
+			unsigned size = get32();
+			if( name == "channels" ) {
+				for( string c = getString(); ok && !c.empty(); c = getString() ) {
+					if( get32() != 2 ) return 0;		// not FLOAT
+					get32(); get32(); get32();
+					channels += c;
+				}
+			}
+			else if( name == "compression" ) compression = get8();
+			else if( name == "dataWindow" ) {
+				x0 = get32(); y0 = get32(); x1 = get32(); y1 = get32();
+			}
+			else if( name == "lineOrder" ) lineOrder = get8();
+			else fseek( file, size, SEEK_CUR );
+		}
+		if( !ok || channels != "BGR" || lineOrder != 0 || x1 < x0 || y1 < y0 ) return 0;
+		int chunkRows;
+		switch( compression ) {
+		case 0: case 2: chunkRows = 1; break;
+		case 3: chunkRows = 16; break;
+		default: return 0;
+		}
+
+		int w = x1 - x0 + 1, h = y1 - y0 + 1;
+		vector<unsigned long long> offsets( ( h + chunkRows - 1 ) / chunkRows );
+		for( size_t k = 0; k < offsets.size(); ++k ) offsets[k] = get64();
+		if( !ok ) return 0;
+
+		unsigned char* data = new unsigned char [3 * size_t( w ) * h];
+		for( size_t k = 0; k < offsets.size() && ok; ++k ) {
+			fseek( file, (long) offsets[k], SEEK_SET );
+			int y = (int) get32() - y0;
+			int rows = min( chunkRows, h - y );
+			if( y != (int) k * chunkRows ) ok = false;
+			else ok = readChunk( w, rows, get32(), &data[3 * size_t( w ) * ( h - y - rows )] );
+		}
+		if( !ok ) {
+			delete [] data;
+			return 0;
+		}
+		width = w;
+		height = h;
+		return data;
+	}
+
+private:
+	// Decode one chunk of rows rows, top first, into out, which holds them
+	// bottom first.  The inverse of ExrWriter::writeChunk().
+	bool readChunk( int w, int rows, unsigned size, unsigned char* out )
+	{
+		size_t n = size_t( rows ) * w * 12;
+		if( !ok || size > n ) return false;
+		vector<unsigned char> packed( size ), raw( n );
+		if( fread( &packed[0], 1, size, file ) != size ) return false;
+		if( size == n ) raw = packed;
+		else {
+			vector<unsigned char> split( n );
+			uLongf unpackedSize = n;
+			if( uncompress( &split[0], &unpackedSize, &packed[0], size ) != Z_OK || unpackedSize != n )
+				return false;
+			for( size_t k = 1; k < n; ++k )
+				split[k] = (unsigned char)( split[k] + split[k - 1] - 128 );
+			for( size_t k = 0; k < n; ++k )
+				raw[k] = split[k % 2 ? ( n + 1 ) / 2 + k / 2 : k / 2];
+		}
+
+		for( int r = 0; r < rows; ++r )
+			for( int c = 0; c < 3; ++c )
+				for( int i = 0; i < w; ++i ) {
+					const unsigned char* b = &raw[4 * ( size_t( 3 * r + c ) * w + i )];
+					unsigned u = b[0] | b[1] << 8 | b[2] << 16 | (unsigned) b[3] << 24;
+					float v;
+					memcpy( &v, &u, 4 );
+					// as RayTracer fills its buffer: clamp, then truncate
+					out[3 * ( size_t( rows - 1 - r ) * w + i ) + 2 - c] =
+						(unsigned char)( 255.0 * min( max( (double) v, 0.0 ), 1.0 ) );
+				}
+		return true;
+	}
+
+	unsigned get8()
+	{
+		int c = fgetc( file );
+		if( c == EOF ) ok = false;
+		return (unsigned) c & 0xff;
+	}
+	unsigned get32() { unsigned v = 0; for( int k = 0; k < 4; ++k ) v |= get8() << ( 8 * k ); return v; }
+	unsigned long long get64()
+	{
+		unsigned long long v = get32();
+		return v | (unsigned long long) get32() << 32;
+	}
+	string getString()
+	{
+		string s;
+		for( unsigned c = get8(); ok && c != 0 && s.size() < 256; c = get8() ) s += (char) c;
+		return s;
+	}
+
+	FILE* file;
+	bool ok;
+};
+
+//---------------------------------------------------
+
+unsigned char* readImage( const char* filename, int& width, int& height )
+{
+	if( hasExtension( filename, "png" ) ) return readPng( filename, width, height );
+	if( !hasExtension( filename, "exr" ) ) return readBMP( filename, width, height );
+	FILE* f = fopen( filename, "rb" );
+	if( !f ) return 0;
+	unsigned char* data = ExrReader( f ).read( width, height );
+	fclose( f );
+	return data;
+}
@@ -0,0 +1,18 @@
+//
+// imageReader.h
+//
+// Reads back what the tracer writes, in the layout readBMP() returns: RGB
+// bytes, bottom row first, no padding.  EXR pixels are clamped and
+// truncated to bytes as the tracer's own buffer is, so a .png or .exr
+// render can be compared byte for byte with the .bmp of the same frame.
+//
+
+#ifndef __IMAGEREADER_H__
+#define __IMAGEREADER_H__
+
+// A .png, an .exr as ImageWriter writes them (32-bit float B, G and R,
+// stored or ZIP-compressed scanlines) or else a .bmp.  The caller frees
+// the result with delete []; 0 if the file can't be read.
+unsigned char* readImage( const char* filename, int& width, int& height );
+
+#endif // __IMAGEREADER_H__
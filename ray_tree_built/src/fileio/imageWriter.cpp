@@ -0,0 +1,251 @@
+#include "imageWriter.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cctype>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "zlib.h"
+#include "png.h"
+
+using namespace std;
+
+static bool hasExtension( const char* filename, const char* ext )
+{
+	const char* dot = strrchr( filename, '.' );
+	if( !dot || strpbrk( dot, "\\/" ) ) return false;
+	string e( dot + 1 );
+	for( size_t k = 0; k < e.size(); ++k ) e[k] = (char) tolower( e[k] );
+	return e == ext;
+}
+
+//---[ PNG ]-----------------------------------------
+
+class PngWriter : public ImageWriter {
+public:
+	PngWriter( FILE* f, int w, int h ) : file( f ), width( w ), height( h ), rowsWritten( 0 ),
+		failed( false ), row( 3 * w )
+	{
+		png = png_create_write_struct( PNG_LIBPNG_VER_STRING, NULL, NULL, NULL );
+		info = png ? png_create_info_struct( png ) : NULL;
+		if( !info || setjmp( png_jmpbuf( png ) ) ) {
+			failed = true;
+			return;
+		}
+		png_init_io( png, file );
+		png_set_IHDR( png, info, width, height, 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
+			PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT );
+		png_write_info( png, info );
+	}
+
+	~PngWriter()
+	{
+		if( png ) png_destroy_write_struct( &png, info ? &info : NULL );
+		if( file ) fclose( file );
+	}
+
+	void writeRows( const float* rgb, int rows )
+	{
+		if( failed ) return;
+		if( setjmp( png_jmpbuf( png ) ) ) {
+			failed = true;
+			return;
+		}
+		for( int r = 0; r < rows && rowsWritten < height; ++r, ++rowsWritten ) {
+			// as RayTracer fills its buffer: clamp, then truncate
+			for( int k = 0; k < 3 * width; ++k )
+				row[k] = (png_byte)( 255.0 * min( max( (double) rgb[3 * width * r + k], 0.0 ), 1.0 ) );
+			png_write_row( png, &row[0] );
+		}
+	}
+
+	bool close()
+	{
+		if( !failed && rowsWritten == height ) {
+			if( setjmp( png_jmpbuf( png ) ) ) failed = true;
+			else png_write_end( png, NULL );
+		}
+		bool ok = !failed && rowsWritten == height;
+		png_destroy_write_struct( &png, &info );
+		png = NULL;
+		ok = fclose( file ) == 0 && ok;
+		file = NULL;
+		return ok;
+	}
+
+private:
+	FILE* file;
+	png_structp png;
+	png_infop info;
+	int width, height, rowsWritten;
+	// volatile: set after setjmp() and read after libpng longjmps back
+	volatile bool failed;
+	vector<png_byte> row;
+};
+
+//---[ EXR ]-----------------------------------------
+
+/*
+  A scanline OpenEXR file with 32-bit float B, G and R channels, in
+  chunks of 16 rows deflated as the format's ZIP compression does.  The
+  header is written up front with room for the table of chunk offsets,
+  which is filled in by close() once the chunks are all out.
+*/
+class ExrWriter : public ImageWriter {
+public:
+	static const int CHUNK_ROWS = 16;
+
+	ExrWriter( FILE* f, int w, int h ) : file( f ), width( w ), height( h ), rowsWritten( 0 ),
+		failed( false )
+	{
+		writeHeader();
+		tableStart = ftell( file );
+		offsets.assign( ( height + CHUNK_ROWS - 1 ) / CHUNK_ROWS, 0 );
+		for( size_t k = 0; k < offsets.size(); ++k ) put64( 0 );
+		failed = ferror( file ) != 0;
+	}
+
+	~ExrWriter()
+	{
+		if( file ) fclose( file );
+	}
+
+	void writeRows( const float* rgb, int rows )
+	{
+		for( int r = 0; r < rows && rowsWritten < height; ++r, ++rowsWritten ) {
+			pending.insert( pending.end(), rgb + 3 * width * r, rgb + 3 * width * ( r + 1 ) );
+			if( (int) pending.size() == 3 * width * CHUNK_ROWS || rowsWritten + 1 == height )
+				writeChunk();
+		}
+	}
+
+	bool close()
+	{
+		bool ok = !failed && rowsWritten == height;
+		if( ok ) {
+			fseek( file, tableStart, SEEK_SET );
+			for( size_t k = 0; k < offsets.size(); ++k ) put64( offsets[k] );
+			ok = ferror( file ) == 0;
+		}
+		ok = fclose( file ) == 0 && ok;
+		file = NULL;
+		return ok;
+	}
+
+private:
+	void put( const void* p, size_t n ) { fwrite( p, 1, n, file ); }
+	void put8( unsigned v ) { unsigned char b = (unsigned char) v; put( &b, 1 ); }
+	void put32( unsigned v ) { for( int k = 0; k < 4; ++k ) put8( v >> ( 8 * k ) ); }
+	void put64( unsigned long long v ) { for( int k = 0; k < 8; ++k ) put8( (unsigned)( v >> ( 8 * k ) ) ); }
+	void putFloat( float v ) { unsigned u; memcpy( &u, &v, 4 ); put32( u ); }
+	void putString( const char* s ) { put( s, strlen( s ) + 1 ); }
+
+	void attribute( const char* name, const char* type, unsigned size )
+	{
+		putString( name );
+		putString( type );
+		put32( size );
+	}
+
+	void writeHeader()
+	{
+		put32( 20000630 );		// magic number
+		put32( 2 );				// version 2, single-part scanline image
+
+		// channels are listed, and stored, in alphabetical order
+		attribute( "channels", "chlist", 3 * 18 + 1 );
+		const char* names[] = { "B", "G", "R" };
+		for( int c = 0; c < 3; ++c ) {
+			putString( names[c] );
+			put32( 2 );			// FLOAT
+			put32( 0 );			// pLinear and reserved
+			put32( 1 );			// x and y sampling
+			put32( 1 );
+		}
+		put8( 0 );
+
+		attribute( "compression", "compression", 1 );
+		put8( 3 );				// ZIP, 16 scanlines per chunk
+		attribute( "dataWindow", "box2i", 16 );
+		put32( 0 ); put32( 0 ); put32( width - 1 ); put32( height - 1 );
+		attribute( "displayWindow", "box2i", 16 );
+		put32( 0 ); put32( 0 ); put32( width - 1 ); put32( height - 1 );
+		attribute( "lineOrder", "lineOrder", 1 );
+		put8( 0 );				// INCREASING_Y: top row first
+		attribute( "pixelAspectRatio", "float", 4 );
+		putFloat( 1.0f );
+		attribute( "screenWindowCenter", "v2f", 8 );
+		putFloat( 0.0f ); putFloat( 0.0f );
+		attribute( "screenWindowWidth", "float", 4 );
+		putFloat( 1.0f );
+		put8( 0 );				// end of header
+	}
+
+	// Write the rows in pending as one chunk: each row's B, then G, then
+	// R values, with the bytes split into odd and even halves and
+	// delta-coded before deflating, which is what EXR readers undo.  A
+	// chunk that doesn't shrink is stored as it is, as the format allows.
+	void writeChunk()
+	{
+		int rows = (int) pending.size() / ( 3 * width );
+		int firstRow = rowsWritten + 1 - rows;
+
+		vector<unsigned char> raw;
+		raw.reserve( pending.size() * 4 );
+		for( int r = 0; r < rows; ++r )
+			for( int c = 2; c >= 0; --c )
+				for( int i = 0; i < width; ++i ) {
+					unsigned u;
+					memcpy( &u, &pending[3 * ( width * r + i ) + c], 4 );
+					for( int k = 0; k < 4; ++k ) raw.push_back( (unsigned char)( u >> ( 8 * k ) ) );
+				}
+		pending.clear();
+
+		size_t n = raw.size();
+		vector<unsigned char> split( n );
+		for( size_t k = 0; k < n; ++k )
+			split[k % 2 ? ( n + 1 ) / 2 + k / 2 : k / 2] = raw[k];
+		for( size_t k = n - 1; k > 0; --k )
+			split[k] = (unsigned char)( split[k] - split[k - 1] + 128 );
+
+		uLongf packedSize = compressBound( n );
+		vector<unsigned char> packed( packedSize );
+		const unsigned char* data = &raw[0];
+		size_t size = n;
+		if( compress( &packed[0], &packedSize, &split[0], n ) == Z_OK && packedSize < n ) {
+			data = &packed[0];
+			size = packedSize;
+		}
+
+		offsets[firstRow / CHUNK_ROWS] = ftell( file );
+		put32( firstRow );
+		put32( (unsigned) size );
+		put( data, size );
+		if( ferror( file ) ) failed = true;
+	}
+
+	FILE* file;
+	int width, height, rowsWritten;
+	bool failed;
+	long tableStart;
+	vector<unsigned long long> offsets;
+	vector<float> pending;
+};
+
+//---------------------------------------------------
+
+bool ImageWriter::handles( const char* filename )
+{
+	return hasExtension( filename, "png" ) || hasExtension( filename, "exr" );
+}
+
+ImageWriter* ImageWriter::open( const char* filename, int width, int height )
+{
+	if( !handles( filename ) || width <= 0 || height <= 0 ) return 0;
+	FILE* f = fopen( filename, "wb" );
+	if( !f ) return 0;
+	if( hasExtension( filename, "png" ) ) return new PngWriter( f, width, height );
+	return new ExrWriter( f, width, height );
+}
@@ -0,0 +1,34 @@
+//
+// imageWriter.h
+//
+// Writers that take an image a band of rows at a time, top row first, so
+// that a large render can go to disk as it is traced instead of all at
+// the end.  PNG is 8 bits per channel, clamped and quantised the way the
+// tracer's own buffer is; EXR keeps the full float value of each pixel for
+// tone mapping later.
+//
+
+#ifndef __IMAGEWRITER_H__
+#define __IMAGEWRITER_H__
+
+class ImageWriter {
+public:
+	virtual ~ImageWriter() {}
+
+	// rows rows of width RGB triples.  Errors are remembered and reported
+	// by close(), so this can run on another thread than the one that
+	// traces.
+	virtual void writeRows( const float* rgb, int rows ) = 0;
+
+	// Finish the file.  False if anything went wrong since open(), or if
+	// fewer rows than the height were written.
+	virtual bool close() = 0;
+
+	// Whether open() knows filename's extension: .png or .exr.
+	static bool handles( const char* filename );
+
+	// A writer for filename's format, or 0 if the file can't be created.
+	static ImageWriter* open( const char* filename, int width, int height );
+};
+
+#endif // __IMAGEWRITER_H__
@@ -215,3 +215,135 @@ void png_cleanup(int free_image_data) {
 		info_ptr = NULL;
 	}
 }
+
+
+/* Everything below keeps its state on the stack, so any number of images
+ * can be read at once. */
+
+static void png_set_rgb_transforms(png_structp png, png_infop info,
+	int depth, int type, double display_exponent) {
+
+	double  gamma;
+
+	/* same expansions as png_get_image() */
+
+	if (type == PNG_COLOR_TYPE_PALETTE)
+		png_set_expand(png);
+	if (type == PNG_COLOR_TYPE_GRAY && depth < 8)
+		png_set_expand(png);
+	if (png_get_valid(png, info, PNG_INFO_tRNS))
+		png_set_expand(png);
+	if (depth == 16)
+		png_set_strip_16(png);
+	if (type == PNG_COLOR_TYPE_GRAY ||
+		type == PNG_COLOR_TYPE_GRAY_ALPHA)
+		png_set_gray_to_rgb(png);
+
+	if (png_get_gAMA(png, info, &gamma))
+		png_set_gamma(png, display_exponent, gamma);
+}
+
+static FILE *png_open(const char* filename) {
+
+	uch sig[8];
+	FILE *infile;
+
+	if ((infile = fopen(filename, "rb")) == NULL) return NULL;
+	if (fread(sig, 1, 8, infile) != 8 || png_sig_cmp(sig, 0, 8) != 0) {
+		fclose(infile);
+		return NULL;
+	}
+	return infile;
+}
+
+int png_read_size(const char* filename, int &pWidth, int &pHeight) {
+
+	FILE *infile = png_open(filename);
+	if (!infile) return 1;
+
+	png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	png_infop info = png ? png_create_info_struct(png) : NULL;
+	if (!info) {
+		png_destroy_read_struct(&png, NULL, NULL);
+		fclose(infile);
+		return 4;
+	}
+	if (setjmp(png_jmpbuf(png))) {
+		png_destroy_read_struct(&png, &info, NULL);
+		fclose(infile);
+		return 2;
+	}
+
+	png_init_io(png, infile);
+	png_set_sig_bytes(png, 8);
+	png_read_info(png, info);
+	pWidth = (int)png_get_image_width(png, info);
+	pHeight = (int)png_get_image_height(png, info);
+
+	png_destroy_read_struct(&png, &info, NULL);
+	fclose(infile);
+	return 0;
+}
+
+uch *png_read_file(const char* filename, double display_exponent, int bottom_up,
+	int &pWidth, int &pHeight, int &pChannels, int &pRowbytes) {
+
+	FILE *infile = png_open(filename);
+	if (!infile) return NULL;
+
+	png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	png_infop info = png ? png_create_info_struct(png) : NULL;
+	if (!info) {
+		png_destroy_read_struct(&png, NULL, NULL);
+		fclose(infile);
+		return NULL;
+	}
+
+	/* written after setjmp(), so they must be volatile to be trusted
+	 * when libpng longjmps back on an error */
+	uch * volatile image = NULL;
+	png_bytepp volatile rows = NULL;
+
+	if (setjmp(png_jmpbuf(png))) {
+		png_destroy_read_struct(&png, &info, NULL);
+		fclose(infile);
+		free(image);
+		free(rows);
+		return NULL;
+	}
+
+	png_init_io(png, infile);
+	png_set_sig_bytes(png, 8);
+	png_read_info(png, info);
+
+	png_uint_32 w = png_get_image_width(png, info);
+	png_uint_32 h = png_get_image_height(png, info);
+	png_set_rgb_transforms(png, info, png_get_bit_depth(png, info),
+		png_get_color_type(png, info), display_exponent);
+	png_read_update_info(png, info);
+
+	png_uint_32 rowbytes = png_get_rowbytes(png, info);
+	image = (uch *)malloc((size_t)rowbytes*h);
+	rows = (png_bytepp)malloc(h*sizeof(png_bytep));
+	if (image && rows) {
+		/* libpng fills rows in file order, top first; pointing them
+		 * upward from the end of the buffer lands the image bottom row
+		 * first without a separate flip */
+		for (png_uint_32 i = 0;  i < h;  ++i)
+			rows[i] = image + (size_t)(bottom_up ? h - 1 - i : i)*rowbytes;
+		png_read_image(png, rows);
+		png_read_end(png, NULL);
+		pWidth = (int)w;
+		pHeight = (int)h;
+		pRowbytes = (int)rowbytes;
+		pChannels = (int)png_get_channels(png, info);
+	} else {
+		free(image);
+		image = NULL;
+	}
+
+	free(rows);
+	png_destroy_read_struct(&png, &info, NULL);
+	fclose(infile);
+	return image;
+}
@@ -27,3 +27,14 @@ uch *png_get_image(double display_exponent, int &pChannels,
                        int &pRowbytes);
 
 void png_cleanup(int free_image_data);
+
+/* Reentrant versions for callers that decode on more than one thread.
+ * png_read_size reads only the header.  png_read_file decodes the whole
+ * image into memory the caller releases with free(); with bottom_up set
+ * the last row of the file comes first.  Both return NULL / nonzero on
+ * failure like the functions above. */
+
+int png_read_size(const char* filename, int &pWidth, int &pHeight);
+
+uch *png_read_file(const char* filename, double display_exponent, int bottom_up,
+                       int &pWidth, int &pHeight, int &pChannels, int &pRowbytes);
@@ -35,7 +35,7 @@ Scene* Parser::parseScene()
   }
 
   Scene* scene = new Scene;
-  auto_ptr<Material> mat( new Material );
+  Material mat;
 
   for( ;; )
   {
@@ -53,8 +53,9 @@ Scene* Parser::parseScene()
       case ROTATE:
       case SCALE:
       case TRANSFORM:
+      case MOTION:
       case LBRACE:
-         parseTransformableElement(scene, &scene->transformRoot, *mat);
+         parseTransformableElement(scene, &scene->transformRoot, mat);
       break;
       case POINT_LIGHT:
          scene->add( parsePointLight( scene ) );
@@ -69,10 +70,7 @@ Scene* Parser::parseScene()
          parseCamera( scene );
          break;
       case MATERIAL:
-		 {
-           auto_ptr<Material> temp( parseMaterialExpression( scene, *mat ));
-		   mat = temp;
-		 }
+         mat = parseMaterialExpression( scene, mat );
          break;
       case SEMICOLON:
          _tokenizer.Read( SEMICOLON );
@@ -165,6 +163,7 @@ void Parser::parseTransformableElement( Scene* scene, TransformNode* transform,
       case ROTATE:
       case SCALE:
       case TRANSFORM:
+      case MOTION:
          parseGeometry(scene, transform, mat);
       break;
       case LBRACE:
@@ -178,7 +177,7 @@ void Parser::parseTransformableElement( Scene* scene, TransformNode* transform,
 // parse a group of geometry, i.e., enclosed in {} blocks.
 void Parser::parseGroup(Scene* scene, TransformNode* transform, const Material& mat )
 {
-  auto_ptr<Material> newMat;
+  Material newMat( mat );
   _tokenizer.Read( LBRACE );
   for( ;; )
   {
@@ -195,17 +194,15 @@ void Parser::parseGroup(Scene* scene, TransformNode* transform, const Material&
       case ROTATE:
       case SCALE:
       case TRANSFORM:
+      case MOTION:
       case LBRACE:
-        parseTransformableElement( scene, transform, newMat.get() ? *newMat : mat );
+        parseTransformableElement( scene, transform, newMat );
         break;
       case RBRACE:
         _tokenizer.Read( RBRACE );
         return;
       case MATERIAL:
-		{
-          auto_ptr<Material> temp(parseMaterialExpression(scene, mat));
-          newMat = temp;
-		}
+        newMat = parseMaterialExpression(scene, mat);
       default:
         throw SyntaxErrorException( "Expected: '}' or geometry", _tokenizer );
     }
@@ -248,6 +245,9 @@ void Parser::parseGeometry(Scene* scene, TransformNode* transform, const Materia
     case TRANSFORM:
       parseTransform(scene, transform, mat);
       return;
+    case MOTION:
+      parseMotion(scene, transform, mat);
+      return;
     default:
       throw ParserFatalException( "Unrecognized geometry type." );
   }
@@ -356,10 +356,53 @@ void Parser::parseTransform(Scene* scene, TransformNode* transform, const Materi
   return;
 }
 
+// motion( x, y, z, child ) moves the child by (x, y, z) while the shutter
+// is open; motion( row1, row2, row3, row4, child ) carries it through the
+// transform those rows make instead.
+void Parser::parseMotion(Scene* scene, TransformNode* transform, const Material& mat)
+{
+  _tokenizer.Read( MOTION );
+  _tokenizer.Read( LPAREN );
+
+  Mat4d end;
+  const Token* next = _tokenizer.Peek();
+  if( SCALAR == next->kind() )
+  {
+    double x = parseScalar();
+    _tokenizer.Read( COMMA );
+    double y = parseScalar();
+    _tokenizer.Read( COMMA );
+    double z = parseScalar();
+    _tokenizer.Read( COMMA );
+    end = Mat4d::createTranslation( x, y, z );
+  }
+  else
+  {
+    Vec4d row1 = parseVec4d();
+    _tokenizer.Read( COMMA );
+    Vec4d row2 = parseVec4d();
+    _tokenizer.Read( COMMA );
+    Vec4d row3 = parseVec4d();
+    _tokenizer.Read( COMMA );
+    Vec4d row4 = parseVec4d();
+    _tokenizer.Read( COMMA );
+    end = Mat4d(row1, row2, row3, row4);
+  }
+
+  TransformNode* child = transform->createChild( Mat4d() );
+  child->setLocalMotion( Mat4d(), end );
+  parseTransformableElement( scene, child, mat );
+
+  _tokenizer.Read( RPAREN );
+  _tokenizer.CondRead(SEMICOLON);
+
+  return;
+}
+
 void Parser::parseSphere(Scene* scene, TransformNode* transform, const Material& mat)
 {
   Sphere* sphere = 0;
-  Material* newMat = 0;
+  Material newMat( mat );
 
   _tokenizer.Read( SPHERE );
   _tokenizer.Read( LBRACE );
@@ -371,7 +414,6 @@ void Parser::parseSphere(Scene* scene, TransformNode* transform, const Material&
     switch( t->kind() )
     {
       case MATERIAL:
-        delete newMat;
         newMat = parseMaterialExpression( scene, mat );
         break;
       case NAME:
@@ -379,7 +421,7 @@ void Parser::parseSphere(Scene* scene, TransformNode* transform, const Material&
         break;
       case RBRACE:
         _tokenizer.Read( RBRACE );
-        sphere = new Sphere(scene, newMat ? newMat : new Material(mat));
+        sphere = scene->getArena().create<Sphere>(scene, newMat);
         sphere->setTransform( transform );
         scene->add( sphere );
         return;
@@ -397,7 +439,7 @@ void Parser::parseBox(Scene* scene, TransformNode* transform, const Material& ma
   _tokenizer.Read( BOX );
   _tokenizer.Read( LBRACE );
 
-  Material* newMat = 0;
+  Material newMat( mat );
   for( ;; )
   {
     const Token* t = _tokenizer.Peek();
@@ -405,7 +447,6 @@ void Parser::parseBox(Scene* scene, TransformNode* transform, const Material& ma
     switch( t->kind() )
     {
       case MATERIAL:
-        delete newMat;
         newMat = parseMaterialExpression( scene, mat );
         break;
       case NAME:
@@ -413,7 +454,7 @@ void Parser::parseBox(Scene* scene, TransformNode* transform, const Material& ma
         break;
       case RBRACE:
          _tokenizer.Read( RBRACE );
-        box = new Box(scene, newMat ? newMat : new Material(mat) );
+        box = scene->getArena().create<Box>(scene, newMat);
         box->setTransform( transform );
         scene->add( box );
         return;
@@ -427,7 +468,7 @@ void Parser::parseBox(Scene* scene, TransformNode* transform, const Material& ma
 void Parser::parseSquare(Scene* scene, TransformNode* transform, const Material& mat)
 {
   Square* square = 0;
-  Material* newMat = 0;
+  Material newMat( mat );
 
   _tokenizer.Read( SQUARE );
   _tokenizer.Read( LBRACE );
@@ -439,7 +480,6 @@ void Parser::parseSquare(Scene* scene, TransformNode* transform, const Material&
     switch( t->kind() )
     {
       case MATERIAL:
-        delete newMat;
         newMat = parseMaterialExpression( scene, mat );
         break;
       case NAME:
@@ -447,7 +487,7 @@ void Parser::parseSquare(Scene* scene, TransformNode* transform, const Material&
         break;
       case RBRACE:
          _tokenizer.Read( RBRACE );
-        square = new Square(scene, newMat ? newMat : new Material(mat));
+        square = scene->getArena().create<Square>(scene, newMat);
         square->setTransform( transform );
         scene->add( square );
         return;
@@ -461,7 +501,7 @@ void Parser::parseSquare(Scene* scene, TransformNode* transform, const Material&
 void Parser::parseCylinder(Scene* scene, TransformNode* transform, const Material& mat)
 {
   Cylinder* cylinder = 0;
-  Material* newMat = 0;
+  Material newMat( mat );
 
   _tokenizer.Read( CYLINDER );
   _tokenizer.Read( LBRACE );
@@ -473,7 +513,6 @@ void Parser::parseCylinder(Scene* scene, TransformNode* transform, const Materia
     switch( t->kind() )
     {
       case MATERIAL:
-        delete newMat;
         newMat = parseMaterialExpression( scene, mat );
         break;
       case NAME:
@@ -481,7 +520,7 @@ void Parser::parseCylinder(Scene* scene, TransformNode* transform, const Materia
         break;
       case RBRACE:
          _tokenizer.Read( RBRACE );
-        cylinder = new Cylinder(scene, newMat ? newMat : new Material(mat));
+        cylinder = scene->getArena().create<Cylinder>(scene, newMat);
         cylinder->setTransform( transform );
         scene->add( cylinder );
         return;
@@ -498,7 +537,7 @@ void Parser::parseCone(Scene* scene, TransformNode* transform, const Material& m
   _tokenizer.Read( LBRACE );
 
   Cone* cone;
-  Material* newMat = 0;
+  Material newMat( mat );
 
   double bottomRadius = 1.0;
   double topRadius = 0.0;
@@ -512,7 +551,6 @@ void Parser::parseCone(Scene* scene, TransformNode* transform, const Material& m
     switch( t->kind() )
     {
       case MATERIAL:
-        delete newMat;
         newMat = parseMaterialExpression( scene, mat );
         break;
       case NAME:
@@ -532,7 +570,7 @@ void Parser::parseCone(Scene* scene, TransformNode* transform, const Material& m
         break;
       case RBRACE:
         _tokenizer.Read( RBRACE );
-        cone = new Cone( scene, newMat ? newMat : new Material(mat), 
+        cone = scene->getArena().create<Cone>( scene, newMat, 
           height, bottomRadius, topRadius, capped );
         cone->setTransform( transform );
         scene->add( cone );
@@ -545,7 +583,7 @@ void Parser::parseCone(Scene* scene, TransformNode* transform, const Material& m
 
 void Parser::parseTrimesh(Scene* scene, TransformNode* transform, const Material& mat)
 {
-  Trimesh* tmesh = new Trimesh( scene, new Material(mat), transform);
+  Trimesh* tmesh = scene->getArena().create<Trimesh>( scene, mat, transform);
 
   _tokenizer.Read( TRIMESH );
   _tokenizer.Read( LBRACE );
@@ -870,11 +908,11 @@ Vec4d Parser::parseVec4dExpression()
   return value;
 }
 
-Material* Parser::parseMaterialExpression( Scene* scene, const Material& parent )
+Material Parser::parseMaterialExpression( Scene* scene, const Material& parent )
 {
   _tokenizer.Read(MATERIAL);
   _tokenizer.Read(EQUALS);
-  Material* mat = parseMaterial( scene, parent );
+  Material mat = parseMaterial( scene, parent );
   _tokenizer.CondRead( SEMICOLON );
   return mat;
 }
@@ -975,12 +1013,12 @@ Vec4d Parser::parseVec4d()
     value4->value() );
 }
 
-Material* Parser::parseMaterial( Scene* scene, const Material& parent )
+Material Parser::parseMaterial( Scene* scene, const Material& parent )
 {
   const Token* tok = _tokenizer.Peek();
   if( IDENT == tok->kind() )
   {
-     return new Material(materials[ tok->ident() ]);
+     return materials[ tok->ident() ];
   }
 
   _tokenizer.Read( LBRACE );
@@ -988,7 +1026,8 @@ Material* Parser::parseMaterial( Scene* scene, const Material& parent )
   bool setReflective( false );
   string name;
 
-  Material* mat = new Material(parent);
+  // a copy to fill in; objects intern it into the scene's table
+  Material mat( parent );
 
   for( ;; )
   {
@@ -996,41 +1035,41 @@ Material* Parser::parseMaterial( Scene* scene, const Material& parent )
     switch( token->kind() )
     {
       case EMISSIVE:
-        mat->setEmissive( parseVec3dMaterialParameter(scene) );
+        mat.setEmissive( parseVec3dMaterialParameter(scene) );
         break;
 
       case AMBIENT:
-        mat->setAmbient( parseVec3dMaterialParameter(scene) );
+        mat.setAmbient( parseVec3dMaterialParameter(scene) );
         break;
 
       case SPECULAR:
       {
         MaterialParameter specular = parseVec3dMaterialParameter(scene);
-        mat->setSpecular( specular );
+        mat.setSpecular( specular );
 //        if( ! setReflective )
 //          mat->setReflective( specular );  // Default kr = ks if none specified
         break;
       }
 
       case DIFFUSE:
-        mat->setDiffuse( parseVec3dMaterialParameter(scene) ); 
+        mat.setDiffuse( parseVec3dMaterialParameter(scene) ); 
         break;
 
       case REFLECTIVE:
-        mat->setReflective( parseVec3dMaterialParameter(scene) );
+        mat.setReflective( parseVec3dMaterialParameter(scene) );
         setReflective = true;
         break;
 
       case TRANSMISSIVE:
-        mat->setTransmissive( parseVec3dMaterialParameter(scene) );
+        mat.setTransmissive( parseVec3dMaterialParameter(scene) );
         break;
 
       case INDEX:
-        mat->setIndex( parseScalarMaterialParameter(scene) );
+        mat.setIndex( parseScalarMaterialParameter(scene) );
         break;
 
       case SHININESS:
-        mat->setShininess( parseScalarMaterialParameter(scene) );
+        mat.setShininess( parseScalarMaterialParameter(scene) );
         break;
 
       case NAME:
@@ -1044,7 +1083,7 @@ Material* Parser::parseMaterial( Scene* scene, const Material& parent )
         if( ! name.empty() )
         {
            if( materials.find( name ) == materials.end() )
-              materials[ name ] = *mat;
+              materials[ name ] = mat;
            else
            {
               ostringstream oss;
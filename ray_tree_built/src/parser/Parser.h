@@ -78,6 +78,7 @@ private:
     void parseRotate(Scene* scene, TransformNode* transform, const Material& mat);
     void parseScale(Scene* scene, TransformNode* transform, const Material& mat);
     void parseTransform(Scene* scene, TransformNode* transform, const Material& mat);
+    void parseMotion(Scene* scene, TransformNode* transform, const Material& mat);
 
     // Helper functions for parsing expressions of the form:
     //   keyword = value;
@@ -85,7 +86,7 @@ private:
     Vec3d parseVec3dExpression();
     Vec4d parseVec4dExpression();
     bool parseBooleanExpression();
-    Material* parseMaterialExpression(Scene* scene, const Material& mat);
+    Material parseMaterialExpression(Scene* scene, const Material& mat);
     string parseIdentExpression();
 
     MaterialParameter parseVec3dMaterialParameter(Scene* scene);
@@ -99,7 +100,7 @@ private:
     Vec3d parseVec3d();
     Vec4d parseVec4d();
     bool parseBoolean();
-    Material* parseMaterial(Scene* scene, const Material& parent);
+    Material parseMaterial(Scene* scene, const Material& parent);
     string parseIdent();
 
   private:
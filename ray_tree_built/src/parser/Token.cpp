@@ -76,6 +76,7 @@ string getNameForToken( const SYMBOL kind )
     tokenNames[ SCALE ]             = "scale";
     tokenNames[ ROTATE ]            = "rotate";
     tokenNames[ TRANSFORM ]         = "transform";
+    tokenNames[ MOTION ]            = "motion";
     tokenNames[ MATERIAL ]          = "material";
     tokenNames[ EMISSIVE ]          = "emissive";
     tokenNames[ AMBIENT ]           = "ambient";
@@ -141,6 +142,7 @@ SYMBOL lookupReservedWord(const string& ident) {
     reservedWords["material"] = MATERIAL;
     reservedWords["materials"] = MATERIALS;
     reservedWords["map"] = MAP;
+    reservedWords["motion"] = MOTION;
     reservedWords["name"] = NAME;
     reservedWords["normals"] = NORMALS;
     reservedWords["point_light"] = POINT_LIGHT;
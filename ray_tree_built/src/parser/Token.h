@@ -74,6 +74,7 @@ enum SYMBOL {
 
   TRANSLATE, SCALE,			// Transforms
   ROTATE, TRANSFORM,
+  MOTION,				// moves across the shutter
 
   MATERIAL, 				// Material settings
   EMISSIVE, AMBIENT, 
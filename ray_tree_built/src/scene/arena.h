@@ -0,0 +1,128 @@
+//
+// arena.h
+//
+// A simple region allocator used for everything that lives exactly as
+// long as a Scene: transform nodes, geometry and trimesh faces.  Materials
+// live only in the scene's MaterialTable.
+//
+
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <utility>
+#include <type_traits>
+
+/*
+  MemoryArena hands out memory by bumping a pointer through large blocks,
+  so building a scene costs a handful of malloc() calls instead of one per
+  object, and objects created one after another (a trimesh and its faces,
+  a transform and the primitive under it) end up next to each other.
+
+  Nothing is freed individually.  Objects created with create() or handed
+  to adopt() have their destructors run, newest first, when the arena is
+  cleared or destroyed.
+*/
+class MemoryArena {
+
+	struct Block {
+		Block* next;
+		size_t size;
+		size_t used;
+		char* data() { return reinterpret_cast<char*>(this + 1); }
+	};
+
+	struct DtorRecord {
+		void (*destroy)(void*);
+		void* object;
+		DtorRecord* next;
+	};
+
+	Block* blocks;
+	DtorRecord* dtors;
+	size_t blockSize;
+	size_t bytesAllocated;
+
+	template <class T>
+	static void destroyObject(void* p) { static_cast<T*>(p)->~T(); }
+
+	Block* newBlock(size_t minSize) {
+		size_t size = minSize > blockSize ? minSize : blockSize;
+		Block* b = static_cast<Block*>(std::malloc(sizeof(Block) + size));
+		if (b == NULL) throw std::bad_alloc();
+		b->next = blocks;
+		b->size = size;
+		b->used = 0;
+		blocks = b;
+		bytesAllocated += size;
+		return b;
+	}
+
+public:
+	explicit MemoryArena(size_t block = 256 * 1024)
+		: blocks(NULL), dtors(NULL), blockSize(block), bytesAllocated(0) {}
+
+	~MemoryArena() { clear(); }
+
+	// Raw, suitably aligned storage.  Never returns NULL.
+	void* alloc(size_t bytes, size_t align = alignof(std::max_align_t)) {
+		Block* b = blocks;
+		if (b) {
+			size_t offset = (b->used + align - 1) & ~(align - 1);
+			if (offset + bytes <= b->size) {
+				b->used = offset + bytes;
+				return b->data() + offset;
+			}
+		}
+		b = newBlock(bytes + align);
+		size_t offset = (reinterpret_cast<size_t>(b->data()) + align - 1) & ~(align - 1);
+		offset -= reinterpret_cast<size_t>(b->data());
+		b->used = offset + bytes;
+		return b->data() + offset;
+	}
+
+	// Make the arena responsible for destroying an object that was
+	// placement-constructed in memory obtained from alloc().
+	template <class T>
+	T* adopt(T* obj) {
+		if (!std::is_trivially_destructible<T>::value) {
+			DtorRecord* rec = static_cast<DtorRecord*>(alloc(sizeof(DtorRecord), alignof(DtorRecord)));
+			rec->destroy = &destroyObject<T>;
+			rec->object = obj;
+			rec->next = dtors;
+			dtors = rec;
+		}
+		return obj;
+	}
+
+	template <class T, class... Args>
+	T* create(Args&&... args) {
+		void* mem = alloc(sizeof(T), alignof(T));
+		return adopt(new (mem) T(std::forward<Args>(args)...));
+	}
+
+	// Destroy everything and give the blocks back.
+	void clear() {
+		while (dtors) {
+			DtorRecord* next = dtors->next;
+			dtors->destroy(dtors->object);
+			dtors = next;
+		}
+		while (blocks) {
+			Block* next = blocks->next;
+			std::free(blocks);
+			blocks = next;
+		}
+		bytesAllocated = 0;
+	}
+
+	size_t bytesReserved() const { return bytesAllocated; }
+
+private:
+	MemoryArena(const MemoryArena&);
+	MemoryArena& operator=(const MemoryArena&);
+};
+
+#endif // __ARENA_H__
@@ -1,29 +1,34 @@
 #pragma once
 
+#include <limits>
+
+#include "../vecmath/simd.h"
+
+// Corners are stored at the geometry precision (Scalar), like rays.
 class BoundingBox {
 	
 	bool bEmpty;
 	bool dirty;
-	Vec3d bmin;
-	Vec3d bmax;
+	Vec3s bmin;
+	Vec3s bmax;
 	double bArea;
 	double bVolume;
 
 public:
 
 	BoundingBox() : bEmpty(true) {}
-	BoundingBox(Vec3d bMin, Vec3d bMax) : bmin(bMin), bmax(bMax), bEmpty(false), dirty(true) {}
+	BoundingBox(Vec3s bMin, Vec3s bMax) : bmin(bMin), bmax(bMax), bEmpty(false), dirty(true) {}
 
-	Vec3d getMin() const { return bmin; }
-	Vec3d getMax() const { return bmax; }
+	Vec3s getMin() const { return bmin; }
+	Vec3s getMax() const { return bmax; }
 	bool isEmpty() { return bEmpty; }
 
-	void setMin(Vec3d bMin) {
+	void setMin(Vec3s bMin) {
 		bmin = bMin;
 		dirty = true;
 		bEmpty = false;
 	}
-	void setMax(Vec3d bMax) {
+	void setMax(Vec3s bMax) {
 		bmax = bMax;
 		dirty = true;
 		bEmpty = false;
@@ -50,7 +55,7 @@ public:
 	}
 
 	// does the box contain this point?
-	bool intersects(const Vec3d& point) const {
+	bool intersects(const Vec3s& point) const {
 		return ((point[0] + RAY_EPSILON >= bmin[0]) && (point[1] + RAY_EPSILON >= bmin[1]) && (point[2] + RAY_EPSILON >= bmin[2]) &&
 			(point[0] - RAY_EPSILON <= bmax[0]) && (point[1] - RAY_EPSILON <= bmax[1]) && (point[2] - RAY_EPSILON <= bmax[2]));
 	}
@@ -58,34 +63,22 @@ public:
 	// if the ray hits the box, put the "t" value of the intersection
 	// closest to the origin in tMin and the "t" value of the far intersection
 	// in tMax and return true, else return false.
-	// Using Kay/Kajiya algorithm.
-	bool intersect(const ray& r, double& tMin, double& tMax) const {
-		Vec3d R0 = r.getPosition();
-		Vec3d Rd = r.getDirection();
-		tMin = -1.0e308; // 1.0e308 is close to infinity... close enough for us!
-		tMax = 1.0e308;
-		double ttemp;
+	// Kay/Kajiya slabs, using the ray's reciprocal direction and sign bits
+	// to pick the near and far plane of each slab without branching.
+	bool intersect(const ray& r, Scalar& tMin, Scalar& tMax) const {
+		tMin = -std::numeric_limits<Scalar>::max(); // close enough to infinity for us!
+		tMax = std::numeric_limits<Scalar>::max();
 	
-		for (int currentaxis = 0; currentaxis < 3; currentaxis++) {
-			double vd = Rd[currentaxis];
-			// if the ray is parallel to the face's plane (=0.0)
-			if( vd == 0.0 ) continue;
-			double v1 = bmin[currentaxis] - R0[currentaxis];
-			double v2 = bmax[currentaxis] - R0[currentaxis];
-			// two slab intersections
-			double t1 = v1/vd;
-			double t2 = v2/vd;
-			if ( t1 > t2 ) { // swap t1 & t2
-				ttemp = t1;
-				t1 = t2;
-				t2 = ttemp;
-			}
-			if (t1 > tMin) tMin = t1;
-			if (t2 < tMax) tMax = t2;
-			if (tMin > tMax) return false; // box is missed
-			if (tMax < RAY_EPSILON) return false; // box is behind ray
+		for (int axis = 0; axis < 3; axis++) {
+			Scalar tNear = ((r.sign[axis] ? bmax : bmin)[axis] - r.p[axis]) * r.invd[axis];
+			Scalar tFar = ((r.sign[axis] ? bmin : bmax)[axis] - r.p[axis]) * r.invd[axis];
+			// A ray lying in a slab plane gives 0 * inf = NaN; every
+			// comparison with NaN is false, so such an axis is ignored.
+			tMin = tNear > tMin ? tNear : tMin;
+			tMax = tFar < tMax ? tFar : tMax;
 		}
-		 return true; // it made it past all 3 axes.
+		// missed, or the box is behind the ray
+		return tMin <= tMax && tMax >= RAY_EPSILON;
 	}
 
 	void operator=(const BoundingBox& target) {
@@ -125,3 +118,94 @@ public:
 		bEmpty = false;
 	}
 };
+
+// Four bounding boxes stored axis by axis, so that one ray can be tested
+// against all of them at once with packed min/max instructions.  The
+// kd-tree keeps the boxes of the objects in each leaf this way.
+class BoundingBox4 {
+
+	alignas(16) Scalar lo[3][4];
+	alignas(16) Scalar hi[3][4];
+
+public:
+
+	// all lanes start out as inverted boxes, which no ray hits
+	BoundingBox4() {
+		for (int axis = 0; axis < 3; axis++)
+			for (int lane = 0; lane < 4; lane++) {
+				lo[axis][lane] = std::numeric_limits<Scalar>::max();
+				hi[axis][lane] = -std::numeric_limits<Scalar>::max();
+			}
+	}
+
+	void set(int lane, const BoundingBox& b) {
+		Vec3s bMin = b.getMin(), bMax = b.getMax();
+		for (int axis = 0; axis < 3; axis++) {
+			lo[axis][lane] = bMin[axis];
+			hi[axis][lane] = bMax[axis];
+		}
+	}
+
+	// for objects without a bounding box, which every ray must test
+	void setInfinite(int lane) {
+		for (int axis = 0; axis < 3; axis++) {
+			lo[axis][lane] = -std::numeric_limits<Scalar>::infinity();
+			hi[axis][lane] = std::numeric_limits<Scalar>::infinity();
+		}
+	}
+
+	// Returns a mask with bit k set if the ray hits box k, entering it no
+	// farther than tLimit; the entry distances are stored in tNear.  Same
+	// rules as BoundingBox::intersect, NaN lanes included: maxps/minps
+	// return their second operand when either one is NaN.
+	int intersect(const ray& r, Scalar tLimit, Scalar tNear[4]) const {
+#if defined(RAY_SIMD_SSE2) && defined(RAY_SINGLE_PRECISION)
+		__m128 tMin = _mm_set1_ps(-std::numeric_limits<Scalar>::max());
+		__m128 tMax = _mm_set1_ps(tLimit);
+		for (int axis = 0; axis < 3; axis++) {
+			__m128 p = _mm_set1_ps(r.p[axis]);
+			__m128 inv = _mm_set1_ps(r.invd[axis]);
+			const Scalar* nearPlane = r.sign[axis] ? hi[axis] : lo[axis];
+			const Scalar* farPlane = r.sign[axis] ? lo[axis] : hi[axis];
+			tMin = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(nearPlane), p), inv), tMin);
+			tMax = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(farPlane), p), inv), tMax);
+		}
+		_mm_storeu_ps(tNear, tMin);
+		__m128 hit = _mm_and_ps(_mm_cmple_ps(tMin, tMax), _mm_cmpge_ps(tMax, _mm_set1_ps(RAY_EPSILON)));
+		return _mm_movemask_ps(hit);
+#elif defined(RAY_SIMD_SSE2)
+		int mask = 0;
+		for (int half = 0; half < 4; half += 2) {
+			__m128d tMin = _mm_set1_pd(-std::numeric_limits<Scalar>::max());
+			__m128d tMax = _mm_set1_pd(tLimit);
+			for (int axis = 0; axis < 3; axis++) {
+				__m128d p = _mm_set1_pd(r.p[axis]);
+				__m128d inv = _mm_set1_pd(r.invd[axis]);
+				const Scalar* nearPlane = (r.sign[axis] ? hi[axis] : lo[axis]) + half;
+				const Scalar* farPlane = (r.sign[axis] ? lo[axis] : hi[axis]) + half;
+				tMin = _mm_max_pd(_mm_mul_pd(_mm_sub_pd(_mm_load_pd(nearPlane), p), inv), tMin);
+				tMax = _mm_min_pd(_mm_mul_pd(_mm_sub_pd(_mm_load_pd(farPlane), p), inv), tMax);
+			}
+			_mm_storeu_pd(tNear + half, tMin);
+			__m128d hit = _mm_and_pd(_mm_cmple_pd(tMin, tMax), _mm_cmpge_pd(tMax, _mm_set1_pd(RAY_EPSILON)));
+			mask |= _mm_movemask_pd(hit) << half;
+		}
+		return mask;
+#else
+		int mask = 0;
+		for (int lane = 0; lane < 4; lane++) {
+			Scalar tMin = -std::numeric_limits<Scalar>::max();
+			Scalar tMax = tLimit;
+			for (int axis = 0; axis < 3; axis++) {
+				Scalar tN = ((r.sign[axis] ? hi : lo)[axis][lane] - r.p[axis]) * r.invd[axis];
+				Scalar tF = ((r.sign[axis] ? lo : hi)[axis][lane] - r.p[axis]) * r.invd[axis];
+				tMin = tN > tMin ? tN : tMin;
+				tMax = tF < tMax ? tF : tMax;
+			}
+			tNear[lane] = tMin;
+			if (tMin <= tMax && tMax >= RAY_EPSILON) mask |= 1 << lane;
+		}
+		return mask;
+#endif
+	}
+};
@@ -0,0 +1,258 @@
+#include "bvh.h"
+#include "scene.h"
+
+#include <algorithm>
+
+using namespace std;
+
+// Relative costs for the surface area heuristic: testing a ray against an
+// object, which means taking the ray into its space first, against one
+// box.
+static const double NODE_COST = 1.0;
+static const double OBJECT_COST = 2.0;
+
+static const int BINS = 16;
+static const int MAX_LEAF = 8;
+
+// Past this depth nodes are split at the median, so that however the
+// heuristic fares no path from the root is longer than the traversal stack.
+static const int SAH_DEPTH = 40;
+static const int STACK_SIZE = 64;
+
+static double area( const BoundingBox& b )
+{
+	Vec3d d = b.getMax() - b.getMin();
+	return 2.0 * ( d[0] * d[1] + d[1] * d[2] + d[2] * d[0] );
+}
+
+static Vec3d centroid( const Geometry* g )
+{
+	const BoundingBox& b = g->getBoundingBox();
+	return ( b.getMin() + b.getMax() ) * 0.5;
+}
+
+void Bvh::build( const vector<Geometry*>& all )
+{
+	nodes.clear();
+	objects.clear();
+	unbounded.clear();
+	for( size_t k = 0; k < all.size(); ++k )
+		( all[k]->hasBoundingBoxCapability() ? objects : unbounded ).push_back( all[k] );
+	if( !objects.empty() ) {
+		nodes.reserve( 2 * objects.size() );
+		nodes.push_back( Node() );
+		buildNode( 0, 0, (int) objects.size(), 0 );
+	}
+	builtCost = cost();
+}
+
+void Bvh::makeLeaf( int self, int begin, int end )
+{
+	nodes[self].first = begin;
+	nodes[self].count = end - begin;
+}
+
+// Fill in node self, which already exists, for objects[begin, end).
+void Bvh::buildNode( int self, int begin, int end, int depth )
+{
+	BoundingBox box, centers;
+	for( int k = begin; k < end; ++k ) {
+		box.merge( objects[k]->getBoundingBox() );
+		Vec3d c = centroid( objects[k] );
+		centers.merge( BoundingBox( c, c ) );
+	}
+	nodes[self].box = box;
+
+	int n = end - begin;
+	if( n <= 2 ) {
+		makeLeaf( self, begin, end );
+		return;
+	}
+
+	Vec3d extent = centers.getMax() - centers.getMin();
+	int axis = 0;
+	if( extent[1] > extent[axis] ) axis = 1;
+	if( extent[2] > extent[axis] ) axis = 2;
+	double lo = centers.getMin()[axis];
+
+	int mid = begin;
+	if( extent[axis] > 0.0 && depth < SAH_DEPTH ) {
+		// bin the centroids along the axis and try a split between each
+		// pair of neighbouring bins
+		BoundingBox binBox[BINS];
+		int binCount[BINS] = { 0 };
+		double scale = BINS / extent[axis];
+		for( int k = begin; k < end; ++k ) {
+			int b = min( BINS - 1, int( ( centroid( objects[k] )[axis] - lo ) * scale ) );
+			binBox[b].merge( objects[k]->getBoundingBox() );
+			binCount[b]++;
+		}
+
+		double rightArea[BINS];
+		int rightCount[BINS];
+		BoundingBox acc;
+		int count = 0;
+		for( int b = BINS - 1; b > 0; --b ) {
+			acc.merge( binBox[b] );
+			count += binCount[b];
+			rightArea[b] = count ? area( acc ) : 0.0;
+			rightCount[b] = count;
+		}
+
+		double best = numeric_limits<double>::max();
+		int bestSplit = -1;
+		acc = BoundingBox();
+		count = 0;
+		for( int b = 0; b < BINS - 1; ++b ) {
+			acc.merge( binBox[b] );
+			count += binCount[b];
+			if( count == 0 || rightCount[b + 1] == 0 ) continue;
+			double c = area( acc ) * count + rightArea[b + 1] * rightCount[b + 1];
+			if( c < best ) {
+				best = c;
+				bestSplit = b;
+			}
+		}
+
+		double parentArea = area( box );
+		double splitCost = NODE_COST + OBJECT_COST * best / ( parentArea > 0.0 ? parentArea : 1.0 );
+		if( bestSplit < 0 || ( splitCost >= OBJECT_COST * n && n <= MAX_LEAF ) ) {
+			makeLeaf( self, begin, end );
+			return;
+		}
+		mid = int( partition( objects.begin() + begin, objects.begin() + end, [&]( Geometry* g ) {
+			return min( BINS - 1, int( ( centroid( g )[axis] - lo ) * scale ) ) <= bestSplit;
+		} ) - objects.begin() );
+	} else if( n <= MAX_LEAF && depth < SAH_DEPTH ) {
+		// all the centres coincide, and no split would separate them
+		makeLeaf( self, begin, end );
+		return;
+	}
+
+	if( mid == begin || mid == end ) {
+		mid = ( begin + end ) / 2;
+		nth_element( objects.begin() + begin, objects.begin() + mid, objects.begin() + end,
+			[&]( Geometry* a, Geometry* b ) { return centroid( a )[axis] < centroid( b )[axis]; } );
+	}
+
+	// children go next to each other so that one index finds both
+	int left = (int) nodes.size();
+	nodes.push_back( Node() );
+	nodes.push_back( Node() );
+	nodes[self].first = left;
+	nodes[self].count = 0;
+	buildNode( left, begin, mid, depth + 1 );
+	buildNode( left + 1, mid, end, depth + 1 );
+}
+
+void Bvh::refit()
+{
+	// children come after their parents, so backwards is bottom up
+	for( size_t k = nodes.size(); k-- > 0; ) {
+		Node& n = nodes[k];
+		BoundingBox box;
+		if( n.count ) {
+			for( int j = n.first; j < n.first + n.count; ++j )
+				box.merge( objects[j]->getBoundingBox() );
+		} else {
+			box.merge( nodes[n.first].box );
+			box.merge( nodes[n.first + 1].box );
+		}
+		n.box = box;
+	}
+}
+
+bool Bvh::update( double maxGrowth )
+{
+	refit();
+	if( cost() <= builtCost * maxGrowth ) return false;
+	vector<Geometry*> all( objects );
+	all.insert( all.end(), unbounded.begin(), unbounded.end() );
+	build( all );
+	return true;
+}
+
+double Bvh::cost() const
+{
+	if( nodes.empty() ) return 0.0;
+	double rootArea = area( nodes[0].box );
+	if( rootArea <= 0.0 ) return OBJECT_COST * objects.size();
+	double sum = 0.0;
+	for( size_t k = 0; k < nodes.size(); ++k ) {
+		const Node& n = nodes[k];
+		sum += area( n.box ) * ( n.count ? OBJECT_COST * n.count : NODE_COST );
+	}
+	return sum / rootArea;
+}
+
+bool Bvh::intersect( ray& r, isect& i ) const
+{
+	RayCounters& stats = RenderStats::local();
+	bool haveOne = false;
+
+	for( size_t k = 0; k < unbounded.size(); ++k ) {
+		isect cur;
+		stats.primitiveTests++;
+		if( unbounded[k]->intersect( r, cur ) ) {
+			stats.primitiveHits++;
+			if( !haveOne || cur.t < i.t ) {
+				i = cur;
+				haveOne = true;
+			}
+		}
+	}
+	if( nodes.empty() ) return haveOne;
+
+	// nodes still to visit, with where the ray enters their boxes
+	int stack[STACK_SIZE];
+	Scalar enter[STACK_SIZE];
+	int top = 0;
+	Scalar tMin, tMax;
+	if( nodes[0].box.intersect( r, tMin, tMax ) ) {
+		stack[top] = 0;
+		enter[top++] = tMin;
+	}
+
+	while( top > 0 ) {
+		--top;
+		if( haveOne && enter[top] > i.t ) continue;
+		const Node& n = nodes[stack[top]];
+		stats.nodeVisits++;
+
+		if( n.count ) {
+			for( int k = n.first; k < n.first + n.count; ++k ) {
+				isect cur;
+				stats.primitiveTests++;
+				if( objects[k]->intersect( r, cur ) ) {
+					stats.primitiveHits++;
+					if( !haveOne || cur.t < i.t ) {
+						i = cur;
+						haveOne = true;
+					}
+				}
+			}
+			continue;
+		}
+
+		// push the farther child first, so the nearer is visited first
+		Scalar t0, t1, u0, u1;
+		bool hitLeft = nodes[n.first].box.intersect( r, t0, t1 );
+		bool hitRight = nodes[n.first + 1].box.intersect( r, u0, u1 );
+		if( hitLeft && hitRight && u0 < t0 ) {
+			stack[top] = n.first;
+			enter[top++] = t0;
+			stack[top] = n.first + 1;
+			enter[top++] = u0;
+		} else {
+			if( hitRight ) {
+				stack[top] = n.first + 1;
+				enter[top++] = u0;
+			}
+			if( hitLeft ) {
+				stack[top] = n.first;
+				enter[top++] = t0;
+			}
+		}
+	}
+	return haveOne;
+}
@@ -0,0 +1,64 @@
+//
+// bvh.h
+//
+// A bounding volume hierarchy over the scene's objects, for scenes whose
+// objects move.  The kd-tree's split planes are fixed when it is built, so
+// an object that moves out of its cells means building the tree again.
+// The BVH instead refits: its boxes are grown and shrunk around the objects
+// where they are now, at the cost of one pass over the nodes.  Refitting
+// keeps every box correct but can leave them overlapping more and more as
+// objects wander; update() measures the tree by the surface area heuristic
+// and builds it again once refitting has made it too much worse.
+//
+
+#ifndef __BVH_H__
+#define __BVH_H__
+
+#include <vector>
+
+#include "ray.h"
+#include "bbox.h"
+
+class Bvh {
+public:
+	Bvh() : builtCost( 0.0 ) {}
+
+	bool empty() const { return nodes.empty() && unbounded.empty(); }
+
+	// Build from scratch, choosing splits by the surface area heuristic.
+	// The objects' bounds must be up to date.
+	void build( const std::vector<Geometry*>& objects );
+
+	// Recompute every box, bottom up, from the objects' current bounds.
+	void refit();
+
+	// Refit, then build again if that leaves cost() more than maxGrowth
+	// times what it was after the last build.  Returns true if it built.
+	bool update( double maxGrowth );
+
+	// The expected cost of a ray that hits the root box, by the surface
+	// area heuristic: each node's cost weighted by the chance that such a
+	// ray also hits its box, in units of one box test.
+	double cost() const;
+	double costAfterBuild() const { return builtCost; }
+
+	bool intersect( ray& r, isect& i ) const;
+
+private:
+	struct Node {
+		BoundingBox box;
+		int first;		// a leaf's first object, or an inner node's left child;
+					// the right child follows it
+		int count;		// objects in a leaf, 0 for an inner node
+	};
+
+	void buildNode( int self, int begin, int end, int depth );
+	void makeLeaf( int self, int begin, int end );
+
+	std::vector<Node> nodes;		// every parent before its children
+	std::vector<Geometry*> objects;		// in leaf order
+	std::vector<Geometry*> unbounded;	// no box; every ray tests them
+	double builtCost;
+};
+
+#endif // __BVH_H__
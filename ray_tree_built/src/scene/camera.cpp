@@ -26,8 +26,8 @@ Camera::rayThrough(double x, double y, ray &r)
     y -= 0.5;
     Vec3d dir = look + x * u + y * v;
 	dir.normalize();
-	r.p = eye;
-	r.d = dir;
+	r.setPosition(eye);
+	r.setDirection(dir);
 }
 
 void
@@ -0,0 +1,62 @@
+#include "cameraPath.h"
+#include "camera.h"
+
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+CameraPath::CameraPath( const char* filename )
+{
+	ifstream in( filename );
+	if( !in ) throw CameraPathException( string( "can't read camera path '" ) + filename + "'" );
+
+	string line;
+	for( int lineNo = 1; getline( in, line ); ++lineNo ) {
+		istringstream fields( line );
+		string first;
+		if( !( fields >> first ) || first[0] == '#' ) continue;
+
+		fields.clear();
+		fields.str( line );
+		Key k;
+		string rest;
+		fields >> k.frame
+			>> k.position[0] >> k.position[1] >> k.position[2]
+			>> k.viewDir[0] >> k.viewDir[1] >> k.viewDir[2]
+			>> k.upDir[0] >> k.upDir[1] >> k.upDir[2]
+			>> k.fov;
+		ostringstream where;
+		where << filename << ":" << lineNo << ": ";
+		if( !fields || fields >> rest )
+			throw CameraPathException( where.str() + "expected frame, position, viewdir, updir and fov" );
+		if( k.frame < 0 )
+			throw CameraPathException( where.str() + "frame numbers can't be negative" );
+		if( !keys.empty() && k.frame <= keys.back().frame )
+			throw CameraPathException( where.str() + "frames must rise from one keyframe to the next" );
+		if( k.viewDir.length() == 0.0 || ( k.upDir ^ k.viewDir ).length() == 0.0 )
+			throw CameraPathException( where.str() + "viewdir and updir must be nonzero and not parallel" );
+		keys.push_back( k );
+	}
+	if( keys.empty() ) throw CameraPathException( string( "no keyframes in camera path '" ) + filename + "'" );
+}
+
+void CameraPath::apply( int frame, Camera& camera ) const
+{
+	size_t b = 0;
+	while( b + 1 < keys.size() && keys[b].frame < frame ) ++b;
+	size_t a = b > 0 && keys[b].frame > frame ? b - 1 : b;
+	double t = a == b ? 0.0 : double( frame - keys[a].frame ) / double( keys[b].frame - keys[a].frame );
+
+	Vec3d position = keys[a].position * ( 1.0 - t ) + keys[b].position * t;
+	Vec3d view = keys[a].viewDir * ( 1.0 - t ) + keys[b].viewDir * t;
+	Vec3d up = keys[a].upDir * ( 1.0 - t ) + keys[b].upDir * t;
+	// Camera::setLook wants them at right angles and of unit length
+	view.normalize();
+	up -= ( up * view ) * view;
+	up.normalize();
+
+	camera.setEye( position );
+	camera.setLook( view, up );
+	camera.setFOV( keys[a].fov * ( 1.0 - t ) + keys[b].fov * t );
+}
@@ -0,0 +1,57 @@
+//
+// cameraPath.h
+//
+// A camera moving over a range of frames, for rendering an animation.
+// The path is read from a text file of keyframes, one per line:
+//
+//   frame  px py pz  vx vy vz  ux uy uz  fov
+//
+// the frame number, the camera position, view direction and up direction
+// as in a .ray file's camera, and the vertical field of view in degrees.
+// Blank lines and lines starting with # are ignored.  Frames between two
+// keyframes get a camera interpolated linearly between them.
+//
+
+#ifndef __CAMERAPATH_H__
+#define __CAMERAPATH_H__
+
+#include <string>
+#include <vector>
+
+#include "../vecmath/vec.h"
+
+class Camera;
+
+class CameraPathException {
+public:
+	CameraPathException( const std::string& errorMsg ) : _errorMsg( errorMsg ) {}
+	std::string message() { return _errorMsg; }
+
+private:
+	std::string _errorMsg;
+};
+
+class CameraPath {
+public:
+	// Throws CameraPathException if the file can't be read, a line is
+	// malformed, the frames don't rise from line to line, or there are
+	// no keyframes.
+	explicit CameraPath( const char* filename );
+
+	int firstFrame() const { return keys.front().frame; }
+	int lastFrame() const { return keys.back().frame; }
+
+	// Point camera as it is at frame, which should lie within the path.
+	void apply( int frame, Camera& camera ) const;
+
+private:
+	struct Key {
+		int frame;
+		Vec3d position, viewDir, upDir;
+		double fov;
+	};
+
+	std::vector<Key> keys;
+};
+
+#endif // __CAMERAPATH_H__
@@ -2,53 +2,115 @@
 
 #include "../scene/material.h"
 #include <iostream>
+#include <vector>
+#include <algorithm>
+#include <memory>
 #include "ray.h"
-#include "../ui/TraceUI.h"
-extern TraceUI* traceUI;
 
 using namespace std;
 
-class CubeMap {
+/*
+  A summed-area table over one cube face.  Entry (x, y) holds the sum of
+  every texel below and to the left of texel corner (x, y), so the
+  integral over any axis-aligned box of the face costs four lookups no
+  matter how big the box is.  Between corners the table is interpolated
+  bilinearly, which is exact for the piecewise-constant image, so boxes
+  need not line up with texel edges.
+
+  Sums are kept in double: a float table over a large face loses the
+  low bits that small boxes depend on.
+*/
+class SummedAreaTable {
+	int width, height;
+	std::vector<double> sums;	// (width+1) x (height+1) RGB triples
+
+	const double* at(int x, int y) const { return &sums[3 * (y * (width + 1) + x)]; }
+
+	Vec3d corner(int x, int y) const {
+		const double* s = at(x, y);
+		return Vec3d(s[0], s[1], s[2]);
+	}
 
-	TextureMap* tMap[6];
-	int* kernel;
+	// integral over [0,x] x [0,y], x and y in texels
+	Vec3d integral(double x, double y) const {
+		int x0 = std::min((int)x, width - 1), y0 = std::min((int)y, height - 1);
+		double fx = x - x0, fy = y - y0;
+		return (1 - fy) * ((1 - fx) * corner(x0, y0) + fx * corner(x0 + 1, y0))
+			+ fy * ((1 - fx) * corner(x0, y0 + 1) + fx * corner(x0 + 1, y0 + 1));
+	}
 
 public:
-	CubeMap() : kernel(0) { 
-		for (int i = 0; i < 6; i++) tMap[i] = 0;
+	SummedAreaTable() : width(0), height(0) {}
+
+	void build(const TextureMap& map) {
+		width = map.getWidth();
+		height = map.getHeight();
+		sums.assign(3 * (width + 1) * (height + 1), 0.0);
+		for (int y = 0; y < height; y++) {
+			double row[3] = { 0, 0, 0 };
+			for (int x = 0; x < width; x++) {
+				Vec3d c = map.getPixelAt(x, y);
+				const double* below = at(x + 1, y);
+				double* s = &sums[3 * ((y + 1) * (width + 1) + x + 1)];
+				for (int k = 0; k < 3; k++) {
+					row[k] += c[k];
+					s[k] = below[k] + row[k];
+				}
+			}
+		}
 	}
 
-	void setXposMap(TextureMap* m) {
-
-		if(tMap[0] && tMap[0] != m) delete(tMap[0]);
-		if (tMap[0] != m) tMap[0] = m;
-	}
-	void setXnegMap(TextureMap* m) {
-		if(tMap[1] && tMap[1] != m) delete(tMap[1]);
-		if (tMap[1] != m) tMap[1] = m;
-	}
-	void setYposMap(TextureMap* m) {
-		if(tMap[2] && tMap[2] != m) delete(tMap[2]);
-		if (tMap[2] != m) tMap[2] = m;
-	}
-	void setYnegMap(TextureMap* m) {
-		if(tMap[3] && tMap[3] != m) delete(tMap[3]);
-		if (tMap[3] != m) tMap[3] = m;
-	}
-	void setZposMap(TextureMap* m) {
-		if(tMap[4] && tMap[4] != m) delete(tMap[4]);
-		if (tMap[4] != m) tMap[4] = m;
+	bool empty() const { return sums.empty(); }
+
+	// Average over a box of size x size texels centred on (u, v) in
+	// [0,1]^2, cut off at the edges of the face.
+	Vec3d boxAverage(double u, double v, double size) const {
+		double cx = u * width, cy = v * height, half = 0.5 * size;
+		double x0 = std::max(cx - half, 0.0), x1 = std::min(cx + half, double(width));
+		double y0 = std::max(cy - half, 0.0), y1 = std::min(cy + half, double(height));
+		if (x1 <= x0 || y1 <= y0) {
+			int x = std::max(0, std::min((int)cx, width - 1));
+			int y = std::max(0, std::min((int)cy, height - 1));
+			return (corner(x + 1, y + 1) - corner(x, y + 1) - corner(x + 1, y) + corner(x, y));
+		}
+		Vec3d sum = integral(x1, y1) - integral(x0, y1) - integral(x1, y0) + integral(x0, y0);
+		return sum / ((x1 - x0) * (y1 - y0));
 	}
-	void setZnegMap(TextureMap* m) {
-		if(tMap[5] && tMap[5] != m) delete(tMap[5]);
-		if (tMap[5] != m) tMap[5] = m;
+};
+
+class CubeMap {
+
+	// faces come from the TextureCache and may be shared with scenes
+	std::shared_ptr<TextureMap> tMap[6];
+	SummedAreaTable sat[6];
+	int* kernel;
+	int filterwidth;
+
+	void setFace(int face, const std::shared_ptr<TextureMap>& m) {
+		if (tMap[face] != m) {
+			tMap[face] = m;
+			if (m) sat[face].build(*m);
+		}
 	}
 
-	Vec3d getColor(ray r) const{
+public:
+	CubeMap() : kernel(0), filterwidth(1) {}
+
+	void setXposMap(const std::shared_ptr<TextureMap>& m) { setFace(0, m); }
+	void setXnegMap(const std::shared_ptr<TextureMap>& m) { setFace(1, m); }
+	void setYposMap(const std::shared_ptr<TextureMap>& m) { setFace(2, m); }
+	void setYnegMap(const std::shared_ptr<TextureMap>& m) { setFace(3, m); }
+	void setZposMap(const std::shared_ptr<TextureMap>& m) { setFace(4, m); }
+	void setZnegMap(const std::shared_ptr<TextureMap>& m) { setFace(5, m); }
+
+	// Width, in texels, of the box filter applied to camera rays that
+	// escape the scene.  Set once per render rather than read per ray.
+	void setFilterWidth(int w) { filterwidth = std::max(w, 1); }
+	int getFilterWidth() const { return filterwidth; }
+
+	Vec3d getColor(const ray& r) const{
 
-		int filterwidth = traceUI->getFilterWidth();
 		Vec3d dir = r.getDirection();
-		Vec2d coord;
 		double u,v;
 		int front = 0;
 
@@ -94,29 +156,15 @@ public:
 
 		}
 
-		if (r.type() != ray::VISIBILITY || filterwidth == 1){
-			return tMap[front]->getMappedValue(Vec2d(u, v));
+		if (r.type() != ray::VISIBILITY || filterwidth == 1 || sat[front].empty()){
+			return tMap[front]->getMappedValue(Vec2d(u, v), 0.0, TextureMap::CLAMP);
 		}
 
-		int width = tMap[front]->getWidth();
-		int height = tMap[front]->getHeight();
-		double step=1.0/(width>height ? double(height) : double(width) );
-		Vec3d col(0, 0, 0);
-
-		for(int i=0;i<filterwidth;i++){
-			for(int j=0; j<filterwidth;j++){
-				coord[0]=u+i*step;
-				coord[1]=v+j*step;
-	   			col+=tMap[front]->getMappedValue(coord);
-			}
-		}
-		return col/double(filterwidth*filterwidth);
+		return sat[front].boxAverage(u, v, filterwidth);
 
 	}
 
 	~CubeMap() {
-		for (int i = 0; i < 6; i++) 
-			if (tMap[i]) { delete tMap[i]; tMap[i] = 0; }
 		if (kernel) delete[] kernel;
 	}
 };
@@ -0,0 +1,164 @@
+#include "frameBuffer.h"
+#include "../fileio/imageWriter.h"
+#include "../fileio/bitmap.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+void FrameBuffer::resize( int w, int h )
+{
+	width = w;
+	height = h;
+	sums.assign( 4 * size_t( w ) * h, 0.0f );
+	count.assign( size_t( w ) * h, 0u );
+}
+
+void FrameBuffer::clear()
+{
+	fill( sums.begin(), sums.end(), 0.0f );
+	fill( count.begin(), count.end(), 0u );
+}
+
+void FrameBuffer::addSample( int i, int j, const Vec3d& color, double alpha )
+{
+	size_t p = i + size_t( j ) * width;
+	float* s = &sums[4 * p];
+	s[0] += float( color[0] );
+	s[1] += float( color[1] );
+	s[2] += float( color[2] );
+	s[3] += float( alpha );
+	++count[p];
+}
+
+void FrameBuffer::clearPixel( int i, int j )
+{
+	size_t p = i + size_t( j ) * width;
+	fill( &sums[4 * p], &sums[4 * p] + 4, 0.0f );
+	count[p] = 0;
+}
+
+Vec3d FrameBuffer::color( int i, int j ) const
+{
+	size_t p = i + size_t( j ) * width;
+	if( !count[p] ) return Vec3d( 0, 0, 0 );
+	const float* s = &sums[4 * p];
+	return Vec3d( s[0], s[1], s[2] ) / double( count[p] );
+}
+
+double FrameBuffer::alpha( int i, int j ) const
+{
+	size_t p = i + size_t( j ) * width;
+	return count[p] ? sums[4 * p + 3] / double( count[p] ) : 0.0;
+}
+
+void FrameBuffer::toBytes( int i, int j, unsigned char* rgb ) const
+{
+	Vec3d c = color( i, j );
+	c.clamp();
+	rgb[0] = (int)( 255.0 * c[0] );
+	rgb[1] = (int)( 255.0 * c[1] );
+	rgb[2] = (int)( 255.0 * c[2] );
+}
+
+bool FrameBuffer::save( const char* filename ) const
+{
+	if( ImageWriter::handles( filename ) ) {
+		ImageWriter* out = ImageWriter::open( filename, width, height );
+		if( !out ) return false;
+		vector<float> row( 3 * width );
+		for( int j = height - 1; j >= 0; --j ) {
+			for( int i = 0; i < width; ++i ) {
+				Vec3d c = color( i, j );
+				for( int k = 0; k < 3; ++k ) row[3 * i + k] = float( c[k] );
+			}
+			out->writeRows( &row[0], 1 );
+		}
+		bool ok = out->close();
+		delete out;
+		return ok;
+	}
+
+	vector<unsigned char> bytes( 3 * size_t( width ) * height );
+	for( int j = 0; j < height; ++j )
+		for( int i = 0; i < width; ++i )
+			toBytes( i, j, &bytes[3 * ( i + size_t( j ) * width )] );
+	// writeBMP doesn't check that it could open the file
+	FILE* f = fopen( filename, "wb" );
+	if( !f ) return false;
+	fclose( f );
+	writeBMP( filename, width, height, &bytes[0] );
+	return true;
+}
+
+vector<FrameBuffer::Tile> FrameBuffer::tiles( int w, int h, int size )
+{
+	vector<Tile> all;
+	for( int y = 0; y < h; y += size )
+		for( int x = 0; x < w; x += size ) {
+			Tile t = { x, y, min( size, w - x ), min( size, h - y ) };
+			all.push_back( t );
+		}
+	return all;
+}
+
+static const char PARTIAL_MAGIC[8] = { 'R', 'A', 'Y', 'P', 'A', 'R', 'T', '1' };
+
+// header: magic, frame width and height, number of tiles; then each tile's
+// x, y, width and height, followed by its pixels row by row, each as the
+// four float sums and the unsigned count
+bool FrameBuffer::savePartial( const char* filename, const vector<Tile>& tiles ) const
+{
+	FILE* f = fopen( filename, "wb" );
+	if( !f ) return false;
+	int header[3] = { width, height, (int) tiles.size() };
+	fwrite( PARTIAL_MAGIC, 1, sizeof PARTIAL_MAGIC, f );
+	fwrite( header, sizeof header, 1, f );
+	for( size_t t = 0; t < tiles.size(); ++t ) {
+		const Tile& tile = tiles[t];
+		fwrite( &tile, sizeof tile, 1, f );
+		for( int j = tile.y; j < tile.y + tile.height; ++j )
+			for( int i = tile.x; i < tile.x + tile.width; ++i ) {
+				size_t p = i + size_t( j ) * width;
+				fwrite( &sums[4 * p], sizeof( float ), 4, f );
+				fwrite( &count[p], sizeof( unsigned ), 1, f );
+			}
+	}
+	bool ok = !ferror( f );
+	return fclose( f ) == 0 && ok;
+}
+
+bool FrameBuffer::loadPartial( const char* filename )
+{
+	FILE* f = fopen( filename, "rb" );
+	if( !f ) return false;
+	char magic[sizeof PARTIAL_MAGIC];
+	int header[3];
+	bool ok = fread( magic, 1, sizeof magic, f ) == sizeof magic
+		&& memcmp( magic, PARTIAL_MAGIC, sizeof magic ) == 0
+		&& fread( header, sizeof header, 1, f ) == 1
+		&& header[0] > 0 && header[1] > 0 && header[2] >= 0;
+	if( ok && sums.empty() ) resize( header[0], header[1] );
+	ok = ok && header[0] == width && header[1] == height;
+
+	for( int t = 0; ok && t < header[2]; ++t ) {
+		Tile tile;
+		ok = fread( &tile, sizeof tile, 1, f ) == 1
+			&& tile.x >= 0 && tile.y >= 0 && tile.width >= 0 && tile.height >= 0
+			&& tile.x + tile.width <= width && tile.y + tile.height <= height;
+		for( int j = tile.y; ok && j < tile.y + tile.height; ++j )
+			for( int i = tile.x; ok && i < tile.x + tile.width; ++i ) {
+				float s[4];
+				unsigned n;
+				ok = fread( s, sizeof( float ), 4, f ) == 4 && fread( &n, sizeof n, 1, f ) == 1;
+				if( !ok ) break;
+				size_t p = i + size_t( j ) * width;
+				for( int c = 0; c < 4; ++c ) sums[4 * p + c] += s[c];
+				count[p] += n;
+			}
+	}
+	fclose( f );
+	return ok;
+}
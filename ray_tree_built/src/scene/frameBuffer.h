@@ -0,0 +1,71 @@
+//
+// frameBuffer.h
+//
+// What a render accumulates into: for each pixel the float sums of its
+// samples' color and alpha, and how many samples there were.  Nothing is
+// rounded to 8 bits until a pixel is shown or saved, so samples can be
+// added to a pixel over several passes, or sums from separately rendered
+// parts of the image added together, without losing precision.
+//
+
+#ifndef __FRAMEBUFFER_H__
+#define __FRAMEBUFFER_H__
+
+#include <vector>
+
+#include "../vecmath/vec.h"
+
+class FrameBuffer {
+public:
+	FrameBuffer() : width( 0 ), height( 0 ) {}
+
+	// Set the size and clear every pixel.
+	void resize( int w, int h );
+	void clear();
+
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+
+	// Pixels are indexed from the bottom left, as RayTracer's are.
+	void addSample( int i, int j, const Vec3d& color, double alpha = 1.0 );
+	void clearPixel( int i, int j );
+
+	int samples( int i, int j ) const { return count[i + j * width]; }
+
+	// The mean of the pixel's samples, unclamped; 0 with none.
+	Vec3d color( int i, int j ) const;
+	double alpha( int i, int j ) const;
+
+	// Clamp the pixel's color to [0, 1] and store it as 8-bit RGB.
+	void toBytes( int i, int j, unsigned char* rgb ) const;
+
+	// Write the frame as an image: .png, or .exr with unclamped float
+	// color, or otherwise BMP.  False if the file can't be written.
+	bool save( const char* filename ) const;
+
+	// A rectangle of pixels, from its bottom left corner.
+	struct Tile {
+		int x, y, width, height;
+	};
+
+	// The frame cut into size x size tiles, smaller at the top and right
+	// edges, bottom row of tiles first.
+	static std::vector<Tile> tiles( int w, int h, int size );
+
+	// A partial frame file holds the sums and counts of some of the tiles
+	// of a frame, in native byte order, so that parts of one frame can be
+	// rendered by different processes and added up afterwards.
+	// savePartial() writes the given tiles; loadPartial() adds a file's
+	// tiles to this frame, first sizing it to the file's frame if it is
+	// empty.  Both return false if the file can't be written or read, and
+	// loadPartial() if it is not a partial frame or is of another size.
+	bool savePartial( const char* filename, const std::vector<Tile>& tiles ) const;
+	bool loadPartial( const char* filename );
+
+private:
+	int width, height;
+	std::vector<float> sums;			// r, g, b, a per pixel
+	std::vector<unsigned> count;
+};
+
+#endif // __FRAMEBUFFER_H__
@@ -1,9 +1,63 @@
 #include <cmath>
+#include <limits>
 
 #include "light.h"
 
 using namespace std;
 
+// A quarter of an 8-bit step
+const double Light::CULL_THRESHOLD = 1.0 / 1024.0;
+
+// Last opaque object each light's shadow ray hit on this thread.  Holds
+// pointers into one scene only; a new scene empties it.
+static vector<const Geometry*>& occluderSlots(const Scene* scene)
+{
+  static thread_local unsigned long generation = 0;
+  static thread_local vector<const Geometry*> slots;
+  if (generation != scene->getGeneration()) {
+    generation = scene->getGeneration();
+    slots.clear();
+  }
+  return slots;
+}
+
+const Geometry* Light::cachedOccluder() const
+{
+  if (index < 0 || scene->hasTransmissive()) return NULL;
+  vector<const Geometry*>& slots = occluderSlots(scene);
+  return (size_t) index < slots.size() ? slots[index] : NULL;
+}
+
+void Light::rememberOccluder(const isect& i) const
+{
+  if (index < 0 || !i.geometry || scene->hasTransmissive()) return;
+  vector<const Geometry*>& slots = occluderSlots(scene);
+  if ((size_t) index >= slots.size()) slots.resize(index + 1, NULL);
+  slots[index] = i.geometry;
+}
+
+static bool isOpaque(const Vec3d& kt)
+{
+  return kt[0] == 0.0 && kt[1] == 0.0 && kt[2] == 0.0;
+}
+
+// Test the cached occluder alone.  A shadow ray it settles is counted
+// here; one it does not is counted again by Scene::intersect.
+static bool testOccluder(const Geometry* last, ray& shadow, isect& i)
+{
+  RayCounters& stats = RenderStats::local();
+  stats.primitiveTests++;
+  if (!last->intersect(shadow, i)) return false;
+  stats.primitiveHits++;
+  return true;
+}
+
+static Vec3d blocked()
+{
+  RenderStats::local().rays[ray::SHADOW]++;
+  return Vec3d(0.0, 0.0, 0.0);
+}
+
 double DirectionalLight::distanceAttenuation(const Vec3d& P) const
 {
   // distance to light is infinite, so f(di) goes to 0.  Return 1.
@@ -18,10 +72,18 @@ Vec3d DirectionalLight::shadowAttenuation(const ray& r, const Vec3d& p) const
   Vec3d dirShadow = -orientation;
 
   ray shadow(p, dirShadow, ray :: SHADOW);
+  shadow.setTime(r.time);
   isect i;
 
+  const Geometry* last = cachedOccluder();
+  if (last && testOccluder(last, shadow, i) && isOpaque(i.getMaterial().kt(i)))
+    return blocked();
+
+  i = isect();
   if(scene->intersect(shadow, i)){
-    return i.getMaterial().kt(i);
+    Vec3d kt = i.getMaterial().kt(i);
+    if (isOpaque(kt)) rememberOccluder(i);
+    return kt;
   }
 
   return color;
@@ -39,6 +101,17 @@ Vec3d DirectionalLight::getDirection(const Vec3d& P) const
   return -orientation;
 }
 
+void DirectionalLight::bake(LightRecord& rec) const
+{
+  rec.light = this;
+  rec.color = color;
+  rec.direction = -orientation;
+  rec.constantTerm = 1.0;
+  rec.linearTerm = rec.quadraticTerm = 0.0;
+  rec.cullRadius2 = numeric_limits<double>::infinity();
+  rec.isPoint = false;
+}
+
 double PointLight::distanceAttenuation(const Vec3d& P) const
 {
 
@@ -65,6 +138,41 @@ Vec3d PointLight::getDirection(const Vec3d& P) const
   return ret;
 }
 
+double PointLight::influenceRadius() const
+{
+  const double inf = numeric_limits<double>::infinity();
+  if (constantTerm < 0 || linearTerm < 0 || quadraticTerm < 0) return inf;
+
+  // Unshadowed, shade() sees the colour twice over (getColor() times
+  // shadowAttenuation()), so bound the brightness accordingly.
+  double bright = max(color[0], max(color[1], color[2]));
+  bright *= max(bright, 1.0);
+  if (bright <= 0) return 0.0;
+
+  // solve a + b d + c d^2 = bright / threshold for d
+  double k = bright / CULL_THRESHOLD;
+  if (constantTerm >= k) return 0.0;
+  if (quadraticTerm > 0) {
+    double b = linearTerm, c = quadraticTerm;
+    return (-b + sqrt(b * b + 4 * c * (k - constantTerm))) / (2 * c);
+  }
+  if (linearTerm > 0) return (k - constantTerm) / linearTerm;
+  return inf;
+}
+
+void PointLight::bake(LightRecord& rec) const
+{
+  rec.light = this;
+  rec.color = color;
+  rec.position = position;
+  rec.constantTerm = constantTerm;
+  rec.linearTerm = linearTerm;
+  rec.quadraticTerm = quadraticTerm;
+  double r = influenceRadius();
+  rec.cullRadius2 = r * r;
+  rec.isPoint = true;
+}
+
 
 Vec3d PointLight::shadowAttenuation(const ray& r, const Vec3d& p) const
 {
@@ -74,15 +182,26 @@ Vec3d PointLight::shadowAttenuation(const ray& r, const Vec3d& p) const
   dirShadow.normalize();
 
   ray shadow(p, dirShadow, ray :: SHADOW);
+  shadow.setTime(r.time);
   isect i;
+  double distLight = (position - p).length();
+
+  const Geometry* last = cachedOccluder();
+  if (last && testOccluder(last, shadow, i)) {
+    double distIscet = (Vec3d(shadow.at(i.t)) - p).length();
+    if (distIscet <= distLight && isOpaque(i.getMaterial().kt(i)))
+      return blocked();
+  }
 
+  i = isect();
   if(scene->intersect(shadow, i)){
-    double distLight = (position - p).length();
-    double distIscet = (shadow.at(i.t) - p).length();
+    double distIscet = (Vec3d(shadow.at(i.t)) - p).length();
     if(distLight<distIscet){
       return color;
     }
-    return i.getMaterial().kt(i);
+    Vec3d kt = i.getMaterial().kt(i);
+    if (isOpaque(kt)) rememberOccluder(i);
+    return kt;
   }
 
   return color;
@@ -19,10 +19,33 @@ public:
 	virtual Vec3d getColor() const = 0;
 	virtual Vec3d getDirection (const Vec3d& P) const = 0;
 
+	// Fill in everything shading needs to know about this light.
+	virtual void bake(LightRecord& rec) const = 0;
+
+	// Light intensity, before the material's coefficients, below which
+	// a light is not worth a shadow ray.  Used to size the sphere around
+	// a point light outside which it is culled.
+	static const double CULL_THRESHOLD;
+
+	// Position in the scene's light list, set by Scene::add.  Keys the
+	// per-thread record of the last object that shadowed this light.
+	void setIndex(int i) { index = i; }
+
 protected:
-	Light(Scene *scene, const Vec3d& col) : SceneElement(scene), color(col) {}
+	Light(Scene *scene, const Vec3d& col) : SceneElement(scene), color(col), index(-1) {}
+
+	// Shadow rays from neighbouring points tend to hit the same object,
+	// so try the one that last blocked this light on this thread before
+	// searching the whole scene.  Only in scenes where nothing transmits:
+	// there an object that blocks the ray is as good as the nearest one,
+	// but with glass about, the nearest hit decides the attenuation, and
+	// which object was cached depends on the pixels this thread shaded
+	// before.
+	const Geometry* cachedOccluder() const;
+	void rememberOccluder(const isect& i) const;
 
 	Vec3d color;
+	int index;
 
 public:
 	virtual void glDraw(GLenum lightID) const { }
@@ -39,6 +62,7 @@ public:
 	virtual double distanceAttenuation(const Vec3d& P) const;
 	virtual Vec3d getColor() const;
 	virtual Vec3d getDirection(const Vec3d& P) const;
+	virtual void bake(LightRecord& rec) const;
 
 protected:
 	Vec3d 		orientation;
@@ -65,6 +89,11 @@ public:
 	virtual double distanceAttenuation(const Vec3d& P) const;
 	virtual Vec3d getColor() const;
 	virtual Vec3d getDirection(const Vec3d& P) const;
+	virtual void bake(LightRecord& rec) const;
+
+	// Distance beyond which f(d) times the light's brightness stays
+	// under CULL_THRESHOLD; infinite if it never gets there.
+	double influenceRadius() const;
 
 	void setAttenuationConstants(float a, float b, float c)
 	{
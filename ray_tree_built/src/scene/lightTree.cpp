@@ -0,0 +1,126 @@
+#include "lightTree.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+// How much a light can deliver, by the same measure the cull radius uses.
+static double brightness(const LightRecord& rec)
+{
+  double bright = max(rec.color[0], max(rec.color[1], rec.color[2]));
+  return max(bright, 0.0) * max(bright, 1.0);
+}
+
+void LightTree::build(const vector<LightRecord>& records)
+{
+  nodes.clear();
+  vector<int> idx;
+  for (size_t k = 0; k < records.size(); k++)
+    if (records[k].isPoint) idx.push_back((int) k);
+  count = (int) idx.size();
+  if (count == 0) return;
+  nodes.reserve(2 * idx.size());
+  nodes.push_back(Node());
+  buildRange(idx, 0, (int) idx.size(), 0, records);
+}
+
+// Fill in node self, which already exists, for lights idx[begin, end).
+void LightTree::buildRange(vector<int>& idx, int begin, int end, int self,
+                           const vector<LightRecord>& records)
+{
+  Vec3d lo = records[idx[begin]].position, hi = lo;
+  for (int k = begin + 1; k < end; k++) {
+    const Vec3d& p = records[idx[k]].position;
+    lo = minimum(lo, p);
+    hi = maximum(hi, p);
+  }
+
+  if (end - begin == 1) {
+    const LightRecord& rec = records[idx[begin]];
+    Node& n = nodes[self];
+    n.lo = lo;
+    n.hi = hi;
+    n.power = brightness(rec);
+    n.child = -1;
+    n.light = idx[begin];
+    n.constantTerm = rec.constantTerm;
+    n.linearTerm = rec.linearTerm;
+    n.quadraticTerm = rec.quadraticTerm;
+    return;
+  }
+
+  Vec3d extent = hi - lo;
+  int axis = 0;
+  if (extent[1] > extent[axis]) axis = 1;
+  if (extent[2] > extent[axis]) axis = 2;
+  int mid = (begin + end) / 2;
+  nth_element(idx.begin() + begin, idx.begin() + mid, idx.begin() + end,
+    [&](int a, int b) { return records[a].position[axis] < records[b].position[axis]; });
+
+  // children go next to each other so that one index finds both
+  int left = (int) nodes.size();
+  nodes.push_back(Node());
+  nodes.push_back(Node());
+  buildRange(idx, begin, mid, left, records);
+  buildRange(idx, mid, end, left + 1, records);
+
+  Node& n = nodes[self];
+  n.lo = lo;
+  n.hi = hi;
+  n.power = nodes[left].power + nodes[left + 1].power;
+  n.child = left;
+  n.light = -1;
+}
+
+double LightTree::importance(const Node& n, const Vec3d& P) const
+{
+  if (n.child < 0) {
+    double d = (n.lo - P).length();
+    return n.power * min(1.0, 1 / (n.constantTerm + n.linearTerm * d + n.quadraticTerm * d * d));
+  }
+  // squared distance to the box, but never less than its own size, so
+  // that a point inside a cluster does not see every light as infinitely
+  // close
+  double d2 = 0.0, size2 = 0.0;
+  for (int k = 0; k < 3; k++) {
+    double out = max(max(n.lo[k] - P[k], P[k] - n.hi[k]), 0.0);
+    d2 += out * out;
+    double half = 0.5 * (n.hi[k] - n.lo[k]);
+    size2 += half * half;
+  }
+  return n.power / max(max(d2, size2), 1e-12);
+}
+
+int LightTree::sample(const Vec3d& P, double u, double& pdf) const
+{
+  pdf = 0.0;
+  if (nodes.empty()) return -1;
+
+  pdf = 1.0;
+  int at = 0;
+  while (nodes[at].child >= 0) {
+    const Node& left = nodes[nodes[at].child];
+    const Node& right = nodes[nodes[at].child + 1];
+    double il = importance(left, P), ir = importance(right, P);
+    if (!(il + ir > 0.0)) {
+      // nothing to tell them apart; fall back on brightness, then count
+      il = left.power;
+      ir = right.power;
+      if (!(il + ir > 0.0)) il = ir = 1.0;
+    }
+    double pl = il / (il + ir);
+    // reuse u: rescale what is left of it into [0, 1) for the next level
+    if (u < pl) {
+      u /= pl;
+      pdf *= pl;
+      at = nodes[at].child;
+    } else {
+      u = (u - pl) / (1.0 - pl);
+      pdf *= 1.0 - pl;
+      at = nodes[at].child + 1;
+    }
+    u = min(u, 1.0 - 1e-12);
+  }
+  return nodes[at].light;
+}
@@ -0,0 +1,70 @@
+//
+// lightTree.h
+//
+// Baked per-light data for shading, and a tree over the point lights for
+// picking a few of them at random when there are too many to visit all.
+//
+
+#ifndef __LIGHTTREE_H__
+#define __LIGHTTREE_H__
+
+#include <vector>
+
+#include "../vecmath/vec.h"
+
+class Light;
+
+// What Material::shade needs to know about a light, gathered once when
+// the light is added so that the per-point loop makes no virtual calls
+// until it casts a shadow ray.
+struct LightRecord {
+  const Light* light;
+  Vec3d color;
+  Vec3d position;        // point lights
+  Vec3d direction;       // directional lights, pointing towards the light
+  double constantTerm, linearTerm, quadraticTerm;
+  double cullRadius2;    // squared distance beyond which the light is ignored
+  bool isPoint;
+};
+
+/*
+  A binary tree over the point lights, split at the median along the
+  widest axis.  Each node knows the bounds of its lights and their total
+  brightness.  sample() walks from the root to one light, at each node
+  choosing a child in proportion to its brightness over its squared
+  distance from the shading point (at a leaf, the light's own falloff),
+  so nearby bright lights are picked often and far dim ones rarely, and
+  reports the probability of the light it picked.
+*/
+class LightTree {
+public:
+  LightTree() : count(0) {}
+
+  // Directional lights are left out; shade() visits those every time.
+  void build(const std::vector<LightRecord>& records);
+
+  int size() const { return count; }
+
+  // u is uniform in [0, 1).  Returns an index into the records the tree
+  // was built from and the probability of having chosen it, or -1 if
+  // there is nothing to choose from.
+  int sample(const Vec3d& P, double u, double& pdf) const;
+
+private:
+  struct Node {
+    Vec3d lo, hi;
+    double power;
+    int child;      // first of two children, or -1 at a leaf
+    int light;      // record index at a leaf
+    double constantTerm, linearTerm, quadraticTerm;   // leaf falloff
+  };
+
+  void buildRange(std::vector<int>& idx, int begin, int end, int self,
+                  const std::vector<LightRecord>& records);
+  double importance(const Node& n, const Vec3d& P) const;
+
+  std::vector<Node> nodes;
+  int count;
+};
+
+#endif // __LIGHTTREE_H__
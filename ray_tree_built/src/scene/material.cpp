@@ -4,12 +4,94 @@
 #include "../ui/TraceUI.h"
 extern TraceUI* traceUI;
 
+#include <algorithm>
+#include <cmath>
+
 #include "../fileio/bitmap.h"
 #include "../fileio/pngimage.h"
+#include "taskPool.h"
+#include "timeline.h"
+
+#include <cstdlib>
+#include <functional>
+#include <cstring>
+#include <iostream>
+#include <stdint.h>
 
 using namespace std;
 extern bool debugMode;
 
+// What shade() works out once per hit and every light needs.
+struct ShadingPoint {
+  const ray* r;
+  Vec3d P, N, V;
+  Vec3d kd, ks;
+  double ns;
+  bool specular;
+  bool shadows;
+};
+
+// One light's diffuse and specular contribution.  Lights that are out of
+// range or behind the surface return zero without a shadow ray.
+static Vec3d lightContribution(const LightRecord& light, const ShadingPoint& sp)
+{
+  Vec3d L;
+  double distanceAttenuation = 1.0;
+  if (light.isPoint) {
+    L = light.position - sp.P;
+    double d2 = L.length2();
+    // too far away to matter
+    if (d2 > light.cullRadius2) return Vec3d(0, 0, 0);
+    double d = sqrt(d2);
+    L /= d;
+    distanceAttenuation = min( 1.0, 1/( light.constantTerm + light.linearTerm * d + light.quadraticTerm * d * d ) );
+  } else {
+    L = light.direction;
+  }
+
+  // A light behind the surface adds nothing, so it gets no shadow ray.
+  double NL = L*sp.N;
+  if (!(NL > 0.0)) return Vec3d(0, 0, 0);
+
+  Vec3d lightIntensity;
+  if(sp.shadows){
+    Vec3d shadowAttenuation = light.light->shadowAttenuation(*sp.r, offsetRayOrigin(sp.P, sp.N, L));
+    if (shadowAttenuation.iszero()) return Vec3d(0, 0, 0);
+    lightIntensity = light.color % shadowAttenuation * distanceAttenuation;
+  }else{
+    lightIntensity = light.color * distanceAttenuation;
+  }
+
+  Vec3d term = sp.kd*NL;
+  if (sp.specular) {
+    Vec3d R = 2*NL*sp.N-L;
+    R.normalize();
+    term += sp.ks*pow(max((-sp.V*R), 0.0), sp.ns);
+  }
+  return prod(lightIntensity, term);
+}
+
+// Light sampling draws its s'th number from a hash of where the ray hit
+// and which way it was going, rather than from a generator.  The same ray
+// always draws the same lights, whatever thread or process traces it, so
+// renders in parts merge to the whole frame and a re-shade matches a
+// fresh render; the rays of the anti-aliasing loop hit different points,
+// so they still draw different lights and average towards the full loop.
+static double uniformSample(const Vec3d& P, const Vec3d& V, int s)
+{
+  uint64_t h = 0x9e3779b97f4a7c15ull * uint64_t(s + 1);
+  const double v[6] = { P[0], P[1], P[2], V[0], V[1], V[2] };
+  for (int k = 0; k < 6; k++) {
+    uint64_t bits;
+    memcpy(&bits, &v[k], sizeof bits);
+    h = (h ^ bits) * 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+  }
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+  return (h >> 11) * (1.0 / 9007199254740992.0);   // 53 bits in [0, 1)
+}
+
 // Apply the phong model to this point on the surface of the object, returning
 // the color of that point.
 Vec3d Material::shade(Scene *scene, const ray& r, const isect& i) const
@@ -20,35 +102,52 @@ Vec3d Material::shade(Scene *scene, const ray& r, const isect& i) const
 
   Vec3d part_ds(0, 0, 0);
 
-  for ( vector<Light*>::const_iterator litr = scene->beginLights(); 
-    litr != scene->endLights(); 
-    ++litr )
-  {
-    Light* pLight = *litr;
-
-    Vec3d N = i.N;
-    Vec3d L = pLight->getDirection(r.at(i.t));
-    L.normalize();
-
-    Vec3d V = r.d;
-    V.normalize();
-
-    Vec3d R = 2*max((L*N), 0.0)*N-L;
-    R.normalize();
-
-    double ns = shininess(i);
-
-    Vec3d shadowAttenuation = pLight->shadowAttenuation(r, r.at(i.t));
-    double distanceAttenuation = min(pLight->distanceAttenuation(r.at(i.t)), 1.0);
-
-    Vec3d lightIntensity;
-    if(traceUI->shadowSw()){
-      lightIntensity = pLight->getColor() % shadowAttenuation * distanceAttenuation;
-    }else{
-      lightIntensity = pLight->getColor() * distanceAttenuation;
+  // The material's terms are the same for every light; if neither can
+  // contribute there is nothing to do but the emissive and ambient part.
+  Vec3d kd_i = kd(i);
+  Vec3d ks_i = ks(i);
+  bool diffuse = !kd_i.iszero();
+  bool specular = !ks_i.iszero();
+  if (!diffuse && !specular) return part_e + part_a;
+  double ns = specular ? shininess(i) : 0.0;
+
+  ShadingPoint sp;
+  sp.r = &r;
+  sp.P = r.at(i.t);
+  sp.N = i.N;
+  sp.V = r.d;
+  sp.V.normalize();
+  sp.kd = kd_i;
+  sp.ks = ks_i;
+  sp.ns = ns;
+  sp.specular = specular;
+  sp.shadows = traceUI->shadowSw();
+
+  const vector<LightRecord>& lights = scene->getLightRecords();
+  const LightTree& tree = scene->getLightTree();
+  int samples = traceUI->getLightSamples();
+
+  if (samples > 0 && tree.size() > samples) {
+    // Directional lights are always visited.  The point lights are
+    // represented by a few drawn from the light tree, each weighted by
+    // one over (samples x its probability) so that on average the sum
+    // matches the full loop.  The draws are stratified over [0, 1).
+    for ( vector<LightRecord>::const_iterator litr = lights.begin();
+      litr != lights.end();
+      ++litr )
+      if (!litr->isPoint) part_ds += lightContribution(*litr, sp);
+
+    for (int s = 0; s < samples; ++s) {
+      double pdf;
+      int k = tree.sample(sp.P, (s + uniformSample(sp.P, sp.V, s)) / samples, pdf);
+      if (k >= 0 && pdf > 0.0)
+        part_ds += lightContribution(lights[k], sp) / (samples * pdf);
     }
-    part_ds += prod(lightIntensity, (kd(i)*max(N*L, 0.0)+ks(i)*pow(max((-V*R), 0.0), ns)));
-
+  } else {
+    for ( vector<LightRecord>::const_iterator litr = lights.begin();
+      litr != lights.end();
+      ++litr )
+      part_ds += lightContribution(*litr, sp);
   }
 
   return part_e + part_a + part_ds;
@@ -90,32 +189,24 @@ Vec3d Material::shade(Scene *scene, const ray& r, const isect& i) const
 
 
 
-TextureMap::TextureMap( string filename ) {
+TextureMap::TextureMap( string filename )
+	: filename( filename ), width( 0 ), height( 0 ), format( BMP ), loaded( false ) {
 
+	bool ok = false;
 	int start = (int) filename.find_last_of('.');
 	int end = (int) filename.size() - 1;
 	if (start >= 0 && start < end) {
 		string ext = filename.substr(start, end);
 		if (!ext.compare(".png")) {
-			png_cleanup(1);
-			if (!png_init(filename.c_str(), width, height)) {
-				double gamma = 2.2;
-				int channels, rowBytes;
-				unsigned char* indata = png_get_image(gamma, channels, rowBytes);
-				int bufsize = rowBytes * height;
-				data = new unsigned char[bufsize];
-				for (int j = 0; j < height; j++)
-					for (int i = 0; i < rowBytes; i += channels)
-						for (int k = 0; k < channels; k++)
-							*(data + k + i + j * rowBytes) = *(indata + k + i + (height - j - 1) * rowBytes);
-				png_cleanup(1);
-			}
+			format = PNG;
+			ok = !png_read_size(filename.c_str(), width, height);
 		}
-		else
-			if (!ext.compare(".bmp")) data = readBMP(filename.c_str(), width, height);
-			else data = NULL;
-	} else data = NULL;
-	if (data == NULL) {
+		else if (!ext.compare(".bmp")) {
+			format = BMP;
+			ok = readBMPSize(filename.c_str(), width, height);
+		}
+	}
+	if (!ok || width <= 0 || height <= 0) {
 		width = 0;
 		height = 0;
 		string error("Unable to load texture map '");
@@ -123,77 +214,238 @@ TextureMap::TextureMap( string filename ) {
 		error.append("'.");
 		throw TextureMapException(error);
 	}
+	pending = TaskPool::instance().submit(std::bind(&TextureMap::decode, this));
 }
 
-Vec3d TextureMap::getMappedValue( const Vec2d& coord ) const
-{
-  // YOUR CODE HERE
+TextureMap::~TextureMap() {
+	if (pending.valid()) pending.wait();
+}
 
-  // In order to add texture mapping support to the 
-  // raytracer, you need to implement this function.
-  // What this function should do is convert from
-  // parametric space which is the unit square
-  // [0, 1] x [0, 1] in 2-space to bitmap coordinates,
-  // and use these to perform bilinear interpolation
-  // of the values.
+// Runs on the TaskPool.  A file that passed the header check but fails
+// to decode is reported and then looks up as white, like a map that
+// never loaded.
+void TextureMap::decode() {
+	TIMELINE_SCOPE("decode texture");
+	int w = 0, h = 0;
+	if (format == PNG) {
+		double gamma = 2.2;
+		int channels, rowBytes;
+		// ask for the rows bottom first, as BMP stores them
+		unsigned char* indata = png_read_file(filename.c_str(), gamma, 1, w, h, channels, rowBytes);
+		if (indata && w == width && h == height)
+			buildLevels(indata, channels, rowBytes);
+		free(indata);
+	}
+	else {
+		unsigned char* data = readBMP(filename.c_str(), w, h);
+		if (data && w == width && h == height)
+			buildLevels(data, 3, width * 3);
+		delete [] data;
+	}
+	if (levels.empty())
+		cerr << "Unable to decode texture map '" << filename << "'." << endl;
+}
 
-  double width = getWidth() * coord[0];
-  double height = getHeight() * coord[1];
-  int low_width = (int)width;
-  int low_height = (int)height;
-  int high_width = low_width+1;
-  int high_height = low_height+1;
+void TextureMap::finishLoading() const {
+	std::lock_guard<std::mutex> guard(loadLock);
+	if (!loaded.load(std::memory_order_relaxed)) {
+		pending.wait();
+		loaded.store(true, std::memory_order_release);
+	}
+}
 
-  Vec3d pointLowLow = getPixelAt(low_width, low_height);
-  Vec3d pointHighLow = getPixelAt(high_width, low_height);
-  Vec3d pointLowHigh = getPixelAt(low_width, high_height);
-  Vec3d pointHighHigh = getPixelAt(high_width, high_height);
+TextureMap::MipLevel::MipLevel( int w, int h )
+	: width( w ), height( h ), tilesX( (w + TILE - 1) / TILE )
+{
+	int tilesY = (h + TILE - 1) / TILE;
+	texels.assign( size_t(tilesX) * tilesY * TILE * TILE * 4, 0.0f );
+}
 
-  double alphaLowHeight = high_height - height;
-  double alphaHighHeight = height - low_height;
-  double alphaLowWidth = high_width - width;
-  double alphaHighWidth = width - low_width;
+// Convert the decoded 8-bit image to float and build the mip pyramid
+// below it, each level a 2x2 box filter of the one above.
+void TextureMap::buildLevels( const unsigned char* pixels, int channels, int rowBytes )
+{
+	levels.clear();
+	levels.push_back( MipLevel( width, height ) );
+	MipLevel& base = levels[0];
+	for( int y = 0; y < height; ++y ) {
+		const unsigned char* row = pixels + (long) y * rowBytes;
+		for( int x = 0; x < width; ++x ) {
+			const unsigned char* in = row + x * channels;
+			float* out = base.texel( x, y );
+			if( channels >= 3 ) {
+				out[0] = in[0] / 255.0f;
+				out[1] = in[1] / 255.0f;
+				out[2] = in[2] / 255.0f;
+			} else {
+				out[0] = out[1] = out[2] = in[0] / 255.0f;
+			}
+		}
+	}
 
-  return pointLowLow*alphaHighWidth*alphaHighHeight
-  +pointHighLow*alphaLowWidth*alphaHighHeight
-  +pointLowHigh*alphaHighWidth*alphaLowHeight
-  +pointHighHigh*alphaLowWidth*alphaLowHeight;
+	while( levels.back().width > 1 || levels.back().height > 1 ) {
+		const MipLevel& src = levels.back();
+		MipLevel dst( std::max( 1, src.width / 2 ), std::max( 1, src.height / 2 ) );
+		for( int y = 0; y < dst.height; ++y ) {
+			int y0 = std::min( 2 * y, src.height - 1 ), y1 = std::min( 2 * y + 1, src.height - 1 );
+			for( int x = 0; x < dst.width; ++x ) {
+				int x0 = std::min( 2 * x, src.width - 1 ), x1 = std::min( 2 * x + 1, src.width - 1 );
+				const float *a = src.texel( x0, y0 ), *b = src.texel( x1, y0 );
+				const float *c = src.texel( x0, y1 ), *d = src.texel( x1, y1 );
+				float* out = dst.texel( x, y );
+				for( int k = 0; k < 3; ++k )
+					out[k] = 0.25f * ( a[k] + b[k] + c[k] + d[k] );
+			}
+		}
+		levels.push_back( dst );
+	}
+}
 
+static inline int wrapTexel( int x, int size, TextureMap::Wrap wrap )
+{
+	if( wrap == TextureMap::CLAMP )
+		return x < 0 ? 0 : ( x >= size ? size - 1 : x );
+	x %= size;
+	return x < 0 ? x + size : x;
+}
+
+// Bilinear interpolation between the four texels whose centers surround
+// (u, v); texel (x, y) is centered at ((x + 0.5) / width, (y + 0.5) / height).
+Vec3d TextureMap::bilinear( const MipLevel& level, double u, double v, Wrap wrap ) const
+{
+	// bring the coordinates into [0, 1] first so the texel indices
+	// below stay small whatever the input
+	if( wrap == REPEAT ) {
+		u -= floor( u );
+		v -= floor( v );
+	} else {
+		u = std::min( std::max( u, 0.0 ), 1.0 );
+		v = std::min( std::max( v, 0.0 ), 1.0 );
+	}
+	double s = u * level.width - 0.5;
+	double t = v * level.height - 0.5;
+	double fs = floor( s ), ft = floor( t );
+	int x0 = (int) fs, y0 = (int) ft;
+	float wx = float( s - fs ), wy = float( t - ft );
+
+	int xa = wrapTexel( x0, level.width, wrap ), xb = wrapTexel( x0 + 1, level.width, wrap );
+	int ya = wrapTexel( y0, level.height, wrap ), yb = wrapTexel( y0 + 1, level.height, wrap );
+	const float *a = level.texel( xa, ya ), *b = level.texel( xb, ya );
+	const float *c = level.texel( xa, yb ), *d = level.texel( xb, yb );
+
+	Vec3d ret;
+	for( int k = 0; k < 3; ++k ) {
+		float lo = a[k] + wx * ( b[k] - a[k] );
+		float hi = c[k] + wx * ( d[k] - c[k] );
+		ret[k] = lo + wy * ( hi - lo );
+	}
+	return ret;
 }
 
+Vec3d TextureMap::getMappedValue( const Vec2d& coord, double footprint, Wrap wrap ) const
+{
+  waitUntilLoaded();
+
+  // This keeps it from crashing if it can't load
+  // the texture, but the person tries to render anyway.
+  if( levels.empty() )
+    return Vec3d( 1.0, 1.0, 1.0 );
+
+  // level of detail: log2 of the footprint measured in full-size texels
+  double texels = footprint * std::max( width, height );
+  if( !(texels > 1.0) )
+    return bilinear( levels[0], coord[0], coord[1], wrap );
+
+  double lod = std::min( log2( texels ), double( levels.size() - 1 ) );
+  int l0 = (int) lod;
+  double frac = lod - l0;
+  Vec3d ret = bilinear( levels[l0], coord[0], coord[1], wrap );
+  if( frac > 0.0 && l0 + 1 < (int) levels.size() )
+    ret += frac * ( bilinear( levels[l0 + 1], coord[0], coord[1], wrap ) - ret );
+  return ret;
+}
+
+
+// Worked out from the size alone, matching MipLevel and buildLevels, so
+// that the cache can account for an image that is still being decoded.
+size_t TextureMap::memoryUsed() const
+{
+	size_t bytes = 0;
+	int w = width, h = height;
+	for (;;) {
+		size_t tiles = size_t((w + TILE - 1) / TILE) * ((h + TILE - 1) / TILE);
+		bytes += tiles * TILE * TILE * 4 * sizeof(float);
+		if (w <= 1 && h <= 1) break;
+		w = std::max(1, w / 2);
+		h = std::max(1, h / 2);
+	}
+	return bytes;
+}
 
 Vec3d TextureMap::getPixelAt( int x, int y ) const
 {
+    waitUntilLoaded();
+
     // This keeps it from crashing if it can't load
     // the texture, but the person tries to render anyway.
-    if (0 == data)
+    if( levels.empty() )
       return Vec3d(1.0, 1.0, 1.0);
 
-    if( x >= width )
-       x = width - 1;
-    if( y >= height )
-       y = height - 1;
-
-    // Find the position in the big data array...
-    int pos = (y * width + x) * 3;
-    return Vec3d(double(data[pos]) / 255.0, 
-       double(data[pos+1]) / 255.0,
-       double(data[pos+2]) / 255.0);
+    const float* t = levels[0].texel( wrapTexel( x, width, CLAMP ), wrapTexel( y, height, CLAMP ) );
+    return Vec3d( t[0], t[1], t[2] );
 }
 
 Vec3d MaterialParameter::value( const isect& is ) const
 {
     if( 0 != _textureMap )
-        return _textureMap->getMappedValue( is.uvCoordinates );
+        return _textureMap->getMappedValue( is.uvCoordinates, is.uvFootprint );
     else
         return _value;
 }
 
+size_t MaterialParameter::hash() const
+{
+    // adding 0.0 folds -0.0 into 0.0 so equal values hash alike
+    std::hash<double> hd;
+    size_t h = std::hash<TextureMap*>()( _textureMap );
+    for( int k = 0; k < 3; ++k )
+        h = h * 31 + hd( _value[k] + 0.0 );
+    return h;
+}
+
+size_t Material::hash() const
+{
+    size_t h = _ke.hash();
+    h = h * 31 + _ka.hash();
+    h = h * 31 + _ks.hash();
+    h = h * 31 + _kd.hash();
+    h = h * 31 + _kr.hash();
+    h = h * 31 + _kt.hash();
+    h = h * 31 + _shininess.hash();
+    h = h * 31 + _index.hash();
+    return h;
+}
+
+int MaterialTable::intern( const Material& m )
+{
+    size_t h = m.hash();
+    auto range = _lookup.equal_range( h );
+    for( auto it = range.first; it != range.second; ++it )
+        if( _materials[it->second] == m )
+            return it->second;
+
+    int id = (int) _materials.size();
+    _materials.push_back( m );
+    if( m.transmits() ) _transmissive = true;
+    _lookup.insert( std::make_pair( h, id ) );
+    return id;
+}
+
 double MaterialParameter::intensityValue( const isect& is ) const
 {
     if( 0 != _textureMap )
     {
-        Vec3d value( _textureMap->getMappedValue( is.uvCoordinates ) );
+        Vec3d value( _textureMap->getMappedValue( is.uvCoordinates, is.uvFootprint ) );
         return (0.299 * value[0]) + (0.587 * value[1]) + (0.114 * value[2]);
     }
     else
@@ -10,6 +10,11 @@
 #include "../vecmath/vec.h"
 #include "../vecmath/mat.h"
 #include <string>
+#include <vector>
+#include <unordered_map>
+#include <atomic>
+#include <future>
+#include <mutex>
 
 class Scene;
 class ray;
@@ -25,30 +30,79 @@ using std::string;
 */
 class TextureMap {
     public:
+       // Reads just enough of the file to know it is a usable image and
+       // how big it is, throwing TextureMapException if not.  The pixels
+       // are decoded on the TaskPool, and the first lookup waits for them.
        TextureMap( string filename );
-
-       // Return the mapped value; here the coordinate
-       // is assumed to be within the parametrization space:
-       // [0, 1] x [0, 1]
-       // (i.e., {(u, v): 0 <= u <= 1 and 0 <= v <= 1}
-       Vec3d getMappedValue( const Vec2d& coord ) const;
+       ~TextureMap();
+
+       // What lookups outside [0, 1] x [0, 1] see: the image tiled
+       // over the plane, or its edge texels stretched outward.
+       enum Wrap { REPEAT, CLAMP };
+
+       // Return the mapped value; the coordinate's parametrization
+       // space is [0, 1] x [0, 1] (i.e., {(u, v): 0 <= u <= 1 and
+       // 0 <= v <= 1}), extended outside that by wrap.  footprint is
+       // the width, in the same units, of the area the lookup stands
+       // for; it selects the two mip levels to blend.  With a footprint
+       // of a texel or less this is a bilinear lookup in the full-size
+       // image.
+       Vec3d getMappedValue( const Vec2d& coord, double footprint = 0.0,
+                             Wrap wrap = REPEAT ) const;
 
        // Retrieve the value stored in a physical location
-       // (with integer coordinates) in the bitmap.
-       // Should be called from getMappedValue in order to
-       // do bilinear interpolation.
+       // (with integer coordinates) in the full-size image.
        Vec3d getPixelAt( int x, int y ) const;
 
 	   int getWidth() const { return width; }
 	   int getHeight() const { return height; }
+	   int numLevels() const { waitUntilLoaded(); return (int) levels.size(); }
 
-	  ~TextureMap() { if (data) delete[] data; }
+	   // Bytes held by the texels of every level.
+	   size_t memoryUsed() const;
 
 protected:
+       // One level of the mip pyramid.  Texels are converted to float
+       // once at load time and padded to four channels, and the image is
+       // stored in TILE x TILE blocks so that the four texels of a
+       // bilinear lookup are almost always within a cache line or two.
+       enum { TILE_SHIFT = 3, TILE = 1 << TILE_SHIFT };
+       struct MipLevel {
+           int width, height, tilesX;
+           std::vector<float> texels;
+
+           MipLevel( int w, int h );
+           float* texel( int x, int y ) {
+               return &texels[ ( ( ( (y >> TILE_SHIFT) * tilesX + (x >> TILE_SHIFT) ) << (2 * TILE_SHIFT) )
+                   + ( (y & (TILE - 1)) << TILE_SHIFT ) + (x & (TILE - 1)) ) * 4 ];
+           }
+           const float* texel( int x, int y ) const {
+               return const_cast<MipLevel*>( this )->texel( x, y );
+           }
+       };
+
+       void decode();
+       void waitUntilLoaded() const {
+           if( !loaded.load( std::memory_order_acquire ) ) finishLoading();
+       }
+       void finishLoading() const;
+
+       void buildLevels( const unsigned char* pixels, int channels, int rowBytes );
+       Vec3d bilinear( const MipLevel& level, double u, double v, Wrap wrap ) const;
+
        string filename;
        int width;
        int height;
-       unsigned char* data;
+       std::vector<MipLevel> levels;   // levels[0] is the full-size image
+
+       enum Format { PNG, BMP };
+       Format format;
+       mutable std::mutex loadLock;
+       mutable std::future<void> pending;
+       mutable std::atomic<bool> loaded;
+
+       TextureMap( const TextureMap& );
+       TextureMap& operator=( const TextureMap& );
 };
 
 class TextureMapException {
@@ -135,7 +189,7 @@ public:
       _textureMap = 0;
     }
 
-	bool isZero() { return _value.iszero(); }
+	bool isZero() const { return _value[0] == 0.0 && _value[1] == 0.0 && _value[2] == 0.0; }
 
     Vec3d& operator+=( const Vec3d& rhs )
     {
@@ -150,6 +204,13 @@ public:
 	// mapped; use this to determine if we need to somehow renormalize.
 	bool mapped() const { return _textureMap != 0; }
 
+    bool operator==( const MaterialParameter& rhs ) const
+    {
+      return _textureMap == rhs._textureMap && _value == rhs._value;
+    }
+
+    size_t hash() const;
+
 private:
     Vec3d _value;
     TextureMap* _textureMap;
@@ -244,6 +305,21 @@ public:
 	bool Spec() const { return _spec; }
 	bool Both() const { return _both; }
 
+	// Whether light can pass through this material anywhere: kt is
+	// nonzero or comes from a texture.
+	bool transmits() const { return _kt.mapped() || !_kt.isZero(); }
+
+    // Two materials are the same if every parameter holds the same
+    // value and points at the same texture map.
+    bool operator==( const Material& m ) const
+    {
+        return _ke == m._ke && _ka == m._ka && _ks == m._ks && _kd == m._kd &&
+               _kr == m._kr && _kt == m._kt && _shininess == m._shininess &&
+               _index == m._index;
+    }
+
+    size_t hash() const;
+
 private:
     MaterialParameter _ke;                    // emissive
     MaterialParameter _ka;                    // ambient
@@ -286,4 +362,32 @@ operator*( double d, Material m )
     return m;
 }
 
+/*
+MaterialTable is the scene-wide set of distinct materials.  Objects keep
+an index into it rather than their own copy, so the thousands of faces of
+a trimesh (or the many primitives sharing a material in a scene file)
+all refer to one entry, and shading code can look materials up in a
+compact array.  Indices stay valid for the life of the table; references
+returned by operator[] only until the next intern().
+*/
+class MaterialTable
+{
+public:
+    MaterialTable() : _transmissive( false ) {}
+
+    // Returns the index of a material equal to m, adding it if needed.
+    int intern( const Material& m );
+
+    const Material& operator[]( int id ) const { return _materials[id]; }
+    int size() const { return (int) _materials.size(); }
+
+    // Whether any material in the table transmits().
+    bool anyTransmissive() const { return _transmissive; }
+
+private:
+    std::vector<Material> _materials;
+    bool _transmissive;
+    std::unordered_multimap<size_t, int> _lookup;
+};
+
 #endif // __MATERIAL_H__
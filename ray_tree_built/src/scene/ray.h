@@ -10,15 +10,32 @@
 // who the hell cares if my identifiers are longer than 255 characters:
 #pragma warning(disable : 4786)
 
+#include <cfloat>
+#include <cmath>
+#include <algorithm>
+
 #include "../vecmath/vec.h"
 #include "../vecmath/mat.h"
 #include "material.h"
 #include "../ui/TraceUI.h"
 
 class SceneObject;
+class Geometry;
 
 // A ray has a position where the ray starts, and a direction (which should
-// always be normalized!)
+// always be normalized!)  Both are kept at the geometry precision (Scalar).
+// The ray also carries the reciprocal of its direction and which way it
+// points along each axis, for the slab tests in BoundingBox; p and d are
+// public for reading, but change them with setPosition()/setDirection()
+// so those stay in sync.
+//
+// For texture filtering a ray stands for a narrow cone: coneWidth is its
+// width at the origin and coneSpread how much that grows per unit of
+// distance.  Both are zero unless set, which means "a single point".
+//
+// time is when the ray was cast, from 0 at shutter open to 1 at shutter
+// close; moving objects are intersected where they are at that moment,
+// and the rays spawned from a hit carry the same time.
 
 class ray {
 public:
@@ -30,25 +47,44 @@ public:
 		SHADOW
 	};
 
-        ray(const Vec3d &pp, const Vec3d &dd, RayType tt = VISIBILITY)
-	  : p(pp), d(dd), t(tt) {}
-        ray(const ray& other) : p(other.p), d(other.d), t(other.t) {}
+        ray(const Vec3s &pp, const Vec3s &dd, RayType tt = VISIBILITY)
+	  : p(pp), t(tt), coneWidth(0.0), coneSpread(0.0), time(0.0) { setDirection(dd); }
+        ray(const ray& other) = default;
 	~ray() {}
 
-	ray& operator =( const ray& other ) 
-	{ p = other.p; d = other.d; t = other.t; return *this; }
+	ray& operator =( const ray& other ) = default;
+
+	void setPosition( const Vec3s& pp ) { p = pp; }
+	void setDirection( const Vec3s& dd ) {
+		d = dd;
+		// 1/0 is a signed infinity, which the slab tests handle
+		invd = Vec3s( Scalar(1) / d[0], Scalar(1) / d[1], Scalar(1) / d[2] );
+		sign[0] = invd[0] < 0;
+		sign[1] = invd[1] < 0;
+		sign[2] = invd[2] < 0;
+	}
 
-	Vec3d at( double t ) const
+	Vec3s at( Scalar t ) const
 	{ return p + (t*d); }
 
-	Vec3d getPosition() const { return p; }
-	Vec3d getDirection() const { return d; }
+	void setCone( double width, double spread ) { coneWidth = width; coneSpread = spread; }
+	double coneWidthAt( double t ) const { return coneWidth + t * coneSpread; }
+
+	void setTime( double tt ) { time = tt; }
+
+	Vec3s getPosition() const { return p; }
+	Vec3s getDirection() const { return d; }
 	RayType type() const { return t; }
 
 public:
-	Vec3d p;
-	Vec3d d;
+	Vec3s p;
+	Vec3s d;
+	Vec3s invd;		// 1 / d, componentwise
+	int sign[3];	// 1 where d is negative: the slab the ray enters is bmax
 	RayType t;
+	double coneWidth;
+	double coneSpread;
+	double time;
 };
 
 // The description of an intersection point.
@@ -56,14 +92,16 @@ public:
 class isect
 {
 public:
-    isect() : obj( NULL ), t( 0.0 ), N(), material(0) {}
+    isect() : obj( NULL ), geometry( NULL ), t( 0.0 ), N(), uvFootprint( 0.0 ), material(0) {}
 	isect(const isect& other)
 	{
 		obj = other.obj;
+		geometry = other.geometry;
 		t = other.t;
 		N = other.N;
 		bary = other.bary;
 		uvCoordinates = other.uvCoordinates;
+		uvFootprint = other.uvFootprint;
 		if (other.material) material = new Material(*other.material);
 		else material = 0;
 	}
@@ -73,10 +111,12 @@ public:
     isect& operator = (const isect& other) {
         if( this != &other ) {
             obj = other.obj;
+            geometry = other.geometry;
             t = other.t;
             N = other.N;
 			bary = other.bary;
             uvCoordinates = other.uvCoordinates;
+            uvFootprint = other.uvFootprint;
 			if( other.material ) {
                 if( material ) *material = *other.material;
                 else material = new Material(*other.material );
@@ -90,7 +130,7 @@ public:
     }
 
     void setObject(const SceneObject *o) { obj = o; }
-    void setT(double tt) { t = tt; }
+    void setT(Scalar tt) { t = tt; }
     void setN(const Vec3d& n) { N = n; }
     void setMaterial(const Material& m)  { if(material) *material = m; else material = new Material(m); }
     void setUVCoordinates( const Vec2d& coords ) { uvCoordinates = coords; }
@@ -101,15 +141,38 @@ public:
 
 public:
     const SceneObject *obj;
-    double t;
+    const Geometry *geometry;   // the scene-level object hit; obj may be
+                                // a part of it, such as a trimesh face
+    Scalar t;
     Vec3d N;
     Vec2d uvCoordinates;
+    double uvFootprint;         // width of the ray's cone here, in uv units
     Vec3d bary;
     Material *material;         // if this intersection has its own material
                                 // (as opposed to one in its associated object)
                                 // as in the case where the material was interpolated
 };
 
-const double RAY_EPSILON = 0.00000001;
+#ifdef RAY_SINGLE_PRECISION
+const Scalar RAY_EPSILON = 0.00001f;
+#else
+const Scalar RAY_EPSILON = 0.00000001;
+#endif
+
+// Where a secondary ray leaving a surface at p should start.  In double
+// precision RAY_EPSILON alone keeps rays from hitting the surface they
+// left.  Float rounding error grows with the magnitude of the hit point,
+// so single-precision builds also push the origin off the surface, along
+// the normal on the side the new ray travels, by an amount relative to p.
+inline Vec3d offsetRayOrigin( const Vec3d& p, const Vec3d& N, const Vec3d& dir )
+{
+#ifdef RAY_SINGLE_PRECISION
+	double scale = 1.0 + std::max( fabs( p[0] ), std::max( fabs( p[1] ), fabs( p[2] ) ) );
+	double offset = scale * 128.0 * FLT_EPSILON;	// 128 float ulps at |p|
+	return ( N * dir ) < 0.0 ? p - offset * N : p + offset * N;
+#else
+	return p;
+#endif
+}
 
 #endif // __RAY_H__
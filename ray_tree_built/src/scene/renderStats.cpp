@@ -0,0 +1,62 @@
+#include "renderStats.h"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+thread_local RayCounters* RenderStats::threadCounters = 0;
+
+// Blocks outlive the threads that filled them, so a render's totals still
+// include threads that have finished.
+static mutex registryLock;
+static vector< unique_ptr<RayCounters> > registry;
+
+void RayCounters::add( const RayCounters& other )
+{
+	for( int k = 0; k < 4; k++ ) rays[k] += other.rays[k];
+	nodeVisits += other.nodeVisits;
+	primitiveTests += other.primitiveTests;
+	primitiveHits += other.primitiveHits;
+}
+
+RayCounters& RenderStats::registerThread()
+{
+	unique_ptr<RayCounters> c( new RayCounters() );
+	threadCounters = c.get();
+	lock_guard<mutex> guard( registryLock );
+	registry.push_back( move( c ) );
+	return *threadCounters;
+}
+
+void RenderStats::reset()
+{
+	lock_guard<mutex> guard( registryLock );
+	for( size_t k = 0; k < registry.size(); k++ ) *registry[k] = RayCounters();
+}
+
+RayCounters RenderStats::summary()
+{
+	RayCounters total = RayCounters();
+	lock_guard<mutex> guard( registryLock );
+	for( size_t k = 0; k < registry.size(); k++ ) total.add( *registry[k] );
+	return total;
+}
+
+void RenderStats::report( ostream& out )
+{
+	RayCounters s = summary();
+	unsigned long long rays = s.rays[0] + s.rays[1] + s.rays[2] + s.rays[3];
+	out << "rays traced = " << rays
+		<< " (visibility " << s.rays[0] << ", reflection " << s.rays[1]
+		<< ", refraction " << s.rays[2] << ", shadow " << s.rays[3] << ")" << endl;
+	out << "kd-tree nodes visited = " << s.nodeVisits
+		<< ", primitive tests = " << s.primitiveTests
+		<< ", primitive hits = " << s.primitiveHits << endl;
+	if( rays ) {
+		out << "per ray: " << double( s.nodeVisits ) / rays << " nodes, "
+			<< double( s.primitiveTests ) / rays << " tests, "
+			<< double( s.primitiveHits ) / rays << " hits" << endl;
+	}
+}
@@ -0,0 +1,48 @@
+//
+// renderStats.h
+//
+// Counters for where a render spends its time: rays cast by type, kd-tree
+// nodes visited, and primitives tested and hit.  Each thread counts into
+// its own block, so counting needs no locks; summary() adds them up.
+//
+
+#ifndef __RENDERSTATS_H__
+#define __RENDERSTATS_H__
+
+#include <ostream>
+
+struct RayCounters {
+	unsigned long long rays[4];		// indexed by ray::RayType
+	unsigned long long nodeVisits;
+	unsigned long long primitiveTests;
+	unsigned long long primitiveHits;
+
+	// What a ray costs to trace, in the units of the cost heatmap.
+	unsigned long long steps() const { return nodeVisits + primitiveTests; }
+	void add( const RayCounters& other );
+};
+
+class RenderStats {
+public:
+	// This thread's counters.
+	static RayCounters& local()
+	{
+		RayCounters* c = threadCounters;
+		return c ? *c : registerThread();
+	}
+
+	// Zero every thread's counters.  Call between renders, not during one.
+	static void reset();
+
+	// Every thread's counters added together.
+	static RayCounters summary();
+
+	static void report( std::ostream& out );
+
+private:
+	static RayCounters& registerThread();
+
+	static thread_local RayCounters* threadCounters;
+};
+
+#endif // __RENDERSTATS_H__
@@ -2,6 +2,9 @@
 
 #include "scene.h"
 #include "light.h"
+#include "textureCache.h"
+
+#include <atomic>
 #include "../ui/TraceUI.h"
 #include "../ui/GraphicalUI.h"
 
@@ -10,30 +13,56 @@ extern GraphicalUI* graphicalUI;
 using namespace std;
 
 bool Geometry::intersect(ray& r, isect& i) const {
-	double tmin, tmax;
+	Scalar tmin, tmax;
 	if (hasBoundingBoxCapability() && !(bounds.intersect(r, tmin, tmax))) {
 		return false;
 
 	}
+	return intersectCulled(r, i);
+}
+
+// The rest of intersect(), for callers that have already tested the ray
+// against getBoundingBox() themselves.
+bool Geometry::intersectCulled(ray& r, isect& i) const {
+	if (!transform->isMoving())
+		return intersectThrough(r, i, transform->inverseTransform(), transform->normalTransform());
+	// where the object is at the moment the ray was cast
+	Mat4d inverse;
+	Mat3d normi;
+	transform->inverseAt(r.time, inverse, normi);
+	return intersectThrough(r, i, inverse, normi);
+}
+
+bool Geometry::intersectThrough(ray& r, isect& i, const Mat4d& inverse, const Mat3d& normi) const {
 	// Transform the ray into the object's local coordinate space
-	Vec3d pos = transform->globalToLocalCoords(r.p);
-	Vec3d dir = transform->globalToLocalCoords(r.p + r.d) - pos;
+	Vec3d pos = inverse * Vec3d(r.p);
+	Vec3d dir = inverse * Vec3d(r.p + r.d) - pos;
 	double length = dir.length();
 	dir /= length;
-	Vec3d Wpos = r.p;
-	Vec3d Wdir = r.d;
-	r.p = pos;
-	r.d = dir;
+	ray world(r);
+	r.setPosition(pos);
+	r.setDirection(dir);
 	bool rtrn = false;
 	if (intersectLocal(r, i))
 	{
 		// Transform the intersection point & normal returned back into global space.
-		i.N = transform->localToGlobalCoordsNormal(i.N);
+		i.N = normi * i.N;
+		i.N.normalize();
 		i.t /= length;
+		// outermost call last, so a mesh rather than its face
+		i.geometry = this;
 		rtrn = true;
 	}
-	r.p = Wpos;
-	r.d = Wdir;
+	r = world;
+	if (rtrn && r.coneSpread > 0.0) {
+		// The primitives that set uv coordinates use their local x and y
+		// for them, so the cone's width at the hit, brought into local
+		// units and widened where the surface is seen at an angle, is its
+		// footprint in texture space.  The angle is capped so grazing
+		// hits blur rather than reach for the smallest mip level.
+		double cosine = std::max(fabs(i.N * Vec3d(r.d)), 0.1);
+		i.uvFootprint = r.coneWidthAt(i.t) / (transform->averageScale() * cosine);
+	}
 	return rtrn;
 }
 
@@ -49,32 +78,52 @@ bool Geometry::hasBoundingBoxCapability() const {
 	return false;
 }
 
+// Shared by every scene, so no two scenes, or one scene before and after
+// its objects move, ever have the same generation.
+static unsigned long nextGeneration() {
+	static std::atomic<unsigned long> generations(0);
+	return ++generations;
+}
+
+Scene::Scene() : arena(), transformRoot(&arena), objects(), lights(), kdtree(nullptr),
+	kdDepth(0), kdLeafSize(0), motion(false) {
+	generation = nextGeneration();
+}
+
 Scene::~Scene() {
-    giter g;
     liter l;
-    tmap::iterator t;
-    for( g = objects.begin(); g != objects.end(); ++g ) delete (*g);
+    // geometry and materials are released along with the arena
+    delete kdtree;
     for( l = lights.begin(); l != lights.end(); ++l ) delete (*l);
-    for( t = textureCache.begin(); t != textureCache.end(); t++ ) delete (*t).second;
+    // textures belong to the process-wide cache; let go of ours and give
+    // it the chance to drop what nobody else is using
+    textureCache.clear();
+    TextureCache::instance().trim();
 }
 
 // Get any intersection with an object.  Return information about the 
 // intersection through the reference parameter.
 bool Scene::intersect(ray& r, isect& i) const {
-	double tmin = 0.0;
-	double tmax = 0.0;
+	Scalar tmin = 0.0;
+	Scalar tmax = 0.0;
 	bool have_one = false;
 	typedef vector<Geometry*>::const_iterator iter;
+	RayCounters& stats = RenderStats::local();
+	stats.rays[r.type()]++;
 	if(!graphicalUI->m_kdtreeInfo){
 		for(iter j = objects.begin(); j != objects.end(); ++j) {
 			isect cur;
+			stats.primitiveTests++;
 			if( (*j)->intersect(r, cur) ) {
+				stats.primitiveHits++;
 				if(!have_one || (cur.t < i.t)) {
 					i = cur;
 					have_one = true;
 				}
 			}
 		}
+	}else if(!bvh.empty()){
+		have_one = bvh.intersect(r, i);
 	}else{
 		have_one = kdtree->intersect(r, i);
 	}
@@ -85,12 +134,52 @@ bool Scene::intersect(ray& r, isect& i) const {
 	return have_one;
 }
 
+void Scene::buildBvh() {
+	TIMELINE_SCOPE("build BVH");
+	// meshes keep their kd-trees; those are in the mesh's own space and
+	// stay good however the mesh is moved
+	for( giter g = objects.begin(); g != objects.end(); ++g ) (*g)->buildKdTree();
+	bvh.build(objects);
+}
+
+bool Scene::updateTransforms(double maxGrowth) {
+	TIMELINE_SCOPE("update transforms");
+	sceneBounds = BoundingBox();
+	motion = false;
+	for( giter g = objects.begin(); g != objects.end(); ++g ) {
+		(*g)->ComputeBoundingBox();
+		sceneBounds.merge((*g)->getBoundingBox());
+		if( (*g)->isMoving() ) motion = true;
+	}
+	bool rebuilt = false;
+	if( !bvh.empty() ) {
+		rebuilt = bvh.update(maxGrowth);
+	} else if( kdtree ) {
+		delete kdtree;
+		kdtree = new KdTree(kdDepth, sceneBounds, kdLeafSize);
+		kdtree->addObjects(objects);
+		rebuilt = true;
+	}
+	// what a ray hits has changed, so anything cached from before is stale
+	generation = nextGeneration();
+	return rebuilt;
+}
+
+void Scene::add(Light* light) {
+	light->setIndex((int) lights.size());
+	lights.push_back(light);
+	LightRecord rec;
+	light->bake(rec);
+	lightRecords.push_back(rec);
+}
+
 TextureMap* Scene::getTexture(string name) {
 	tmap::const_iterator itr = textureCache.find(name);
 	if(itr == textureCache.end()) {
-		textureCache[name] = new TextureMap(name);
-		return textureCache[name];
-	} else return (*itr).second;
+		std::shared_ptr<TextureMap> texture = TextureCache::instance().acquire(name);
+		textureCache[name] = texture;
+		return texture.get();
+	} else return (*itr).second.get();
 }
 
 
@@ -21,6 +21,11 @@
 #include "material.h"
 #include "camera.h"
 #include "bbox.h"
+#include "bvh.h"
+#include "arena.h"
+#include "lightTree.h"
+#include "renderStats.h"
+#include "timeline.h"
 
 #include "../vecmath/vec.h"
 #include "../vecmath/mat.h"
@@ -52,24 +57,29 @@ class TransformNode {
 protected:
 
   // information about this node's transformation
+  Mat4d    local;     // relative to the parent
+  Mat4d    localEnd;  // the same at shutter close
   Mat4d    xform;
+  Mat4d    xformEnd;  // xform at shutter close
   Mat4d    inverse;
   Mat3d    normi;
+  double   scale;     // how much the transform grows lengths, on average
+  bool     moving;    // xformEnd differs from xform
 
   // information about parent & children
   TransformNode *parent;
   std::vector<TransformNode*> children;
+
+  // children are allocated from (and destroyed by) the owning scene's arena
+  MemoryArena *arena;
     
  public:
   typedef std::vector<TransformNode*>::iterator          child_iter;
   typedef std::vector<TransformNode*>::const_iterator    child_citer;
 
-  ~TransformNode() {
-      for(child_iter c = children.begin(); c != children.end(); ++c ) delete (*c);
-    }
-
   TransformNode *createChild(const Mat4d& xform) {
-    TransformNode *child = new TransformNode(this, xform);
+    void *mem = arena->alloc(sizeof(TransformNode), alignof(TransformNode));
+    TransformNode *child = arena->adopt(new (mem) TransformNode(this, xform));
     children.push_back(child);
     return child;
   }
@@ -81,6 +91,8 @@ protected:
 
   Vec4d localToGlobalCoords(const Vec4d &v) { return xform * v; }
 
+  Vec4d localToGlobalCoordsEnd(const Vec4d &v) { return xformEnd * v; }
+
   Vec3d localToGlobalCoordsNormal(const Vec3d &v) {
     Vec3d ret = normi * v;
     ret.normalize();
@@ -88,23 +100,74 @@ protected:
   }
 
   const Mat4d& transform() const		{ return xform; }
+  const Mat4d& inverseTransform() const	{ return inverse; }
+  const Mat3d& normalTransform() const	{ return normi; }
+  double averageScale() const { return scale; }
+
+  // Whether this node or one above it moves while the shutter is open.
+  // The world transform then runs in a straight line, entry by entry,
+  // from xform at time 0 to xformEnd at time 1: exact for translations,
+  // and close enough for the small turns of one frame's motion.
+  bool isMoving() const { return moving; }
+
+  // The inverse and normal matrix at time in [0, 1], for a moving node.
+  void inverseAt(double time, Mat4d& inv, Mat3d& nrm) const {
+    Mat4d m = xform * (1.0 - time) + xformEnd * time;
+    inv = m.inverse();
+    nrm = m.upper33().inverse().transpose();
+  }
+
+  // Move this node relative to its parent, and with it everything below.
+  // The objects it carries keep their old bounds until the scene's
+  // updateTransforms() is called.
+  void setLocalTransform(const Mat4d& m) {
+    setLocalMotion(m, m);
+  }
+
+  // The same for a node that moves from start at shutter open to end at
+  // shutter close.
+  void setLocalMotion(const Mat4d& start, const Mat4d& end) {
+    local = start;
+    localEnd = end;
+    update();
+  }
 
 protected:
   // protected so that users can't directly construct one of these...
   // force them to use the createChild() method.  Note that they CAN
   // directly create a TransformRoot object.
- TransformNode(TransformNode *parent, const Mat4d& xform ) : children() {
+ TransformNode(TransformNode *parent, const Mat4d& xform, MemoryArena *arena = NULL ) : children() {
       this->parent = parent;
-      if (parent == NULL) this->xform = xform;
-      else this->xform = parent->xform * xform;  
+      this->arena = parent ? parent->arena : arena;
+      local = localEnd = xform;
+      update();
+    }
+
+  // Recompute the cached matrices here and below from the local ones.
+  void update() {
+      if (parent == NULL) {
+        this->xform = local;
+        xformEnd = localEnd;
+      } else {
+        this->xform = parent->xform * local;
+        xformEnd = parent->xformEnd * localEnd;
+      }
+      moving = xformEnd != this->xform;
       inverse = this->xform.inverse();
       normi = this->xform.upper33().inverse().transpose();
+      // cube root of the volume scale factor, |det| of the linear part
+      Mat3d m = this->xform.upper33();
+      double det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+                 - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+                 + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+      scale = cbrt(fabs(det));
+      for (size_t k = 0; k < children.size(); k++) children[k]->update();
     }
 };
 
 class TransformRoot : public TransformNode {
  public:
- TransformRoot() : TransformNode(NULL, Mat4d()) {}
+ TransformRoot(MemoryArena *arena) : TransformNode(NULL, Mat4d(), arena) {}
 };
 
 // A Geometry object is anything that has extent in three dimensions.
@@ -121,7 +184,10 @@ class Geometry : public SceneElement {
 public:
   // intersections performed in the global coordinate space.
   bool intersect(ray& r, isect& i) const;
+  // the same, skipping the bounding box test the caller has already done
+  bool intersectCulled(ray& r, isect& i) const;
 
+  bool isMoving() const { return transform->isMoving(); }
 
   virtual bool hasBoundingBoxCapability() const;
   const BoundingBox& getBoundingBox() const { return bounds; }
@@ -138,30 +204,16 @@ public:
 
     Vec4d v, newMax, newMin;
 
-    v = transform->localToGlobalCoords( Vec4d(min[0], min[1], min[2], 1) );
-    newMax = v;
-    newMin = v;
-    v = transform->localToGlobalCoords( Vec4d(max[0], min[1], min[2], 1) );
-    newMax = maximum(newMax, v);
-    newMin = minimum(newMin, v);
-    v = transform->localToGlobalCoords( Vec4d(min[0], max[1], min[2], 1) );
-    newMax = maximum(newMax, v);
-    newMin = minimum(newMin, v);
-    v = transform->localToGlobalCoords( Vec4d(max[0], max[1], min[2], 1) );
-    newMax = maximum(newMax, v);
-    newMin = minimum(newMin, v);
-    v = transform->localToGlobalCoords( Vec4d(min[0], min[1], max[2], 1) );
-    newMax = maximum(newMax, v);
-    newMin = minimum(newMin, v);
-    v = transform->localToGlobalCoords( Vec4d(max[0], min[1], max[2], 1) );
-    newMax = maximum(newMax, v);
-    newMin = minimum(newMin, v);
-    v = transform->localToGlobalCoords( Vec4d(min[0], max[1], max[2], 1) );
-    newMax = maximum(newMax, v);
-    newMin = minimum(newMin, v);
-    v = transform->localToGlobalCoords( Vec4d(max[0], max[1], max[2], 1) );
-    newMax = maximum(newMax, v);
-    newMin = minimum(newMin, v);
+    // A moving object's corners each run in a straight line across the
+    // shutter, so the box around both ends holds it throughout.
+    int ends = transform->isMoving() ? 2 : 1;
+    for (int end = 0; end < ends; end++)
+      for (int c = 0; c < 8; c++) {
+        Vec4d corner(c & 1 ? max[0] : min[0], c & 2 ? max[1] : min[1], c & 4 ? max[2] : min[2], 1);
+        v = end ? transform->localToGlobalCoordsEnd(corner) : transform->localToGlobalCoords(corner);
+        newMax = end || c ? maximum(newMax, v) : v;
+        newMin = end || c ? minimum(newMin, v) : v;
+      }
 		
     bounds.setMax(Vec3d(newMax));
     bounds.setMin(Vec3d(newMin));
@@ -188,6 +240,9 @@ public:
  protected:
   BoundingBox bounds;
   TransformNode *transform;
+
+ private:
+  bool intersectThrough(ray& r, isect& i, const Mat4d& inverse, const Mat3d& normi) const;
 };
 
 // A SceneObject is a real actual thing that we want to model in the 
@@ -198,7 +253,7 @@ class SceneObject : public Geometry {
 
  public:
   virtual const Material& getMaterial() const = 0;
-  virtual void setMaterial(Material *m) = 0;
+  virtual void setMaterial(const Material& m) = 0;
 
   void glDraw(int quality, bool actualMaterials, bool actualTextures) const;
 
@@ -207,21 +262,23 @@ class SceneObject : public Geometry {
    : Geometry( scene ) {}
 };
 
-// A simple extension of SceneObject that adds an instance of Material
-// for simple material bindings.
+// A simple extension of SceneObject that adds a Material for simple
+// material bindings.  The material itself lives in the scene's material
+// table; the object only keeps its index.
 class MaterialSceneObject : public SceneObject {
 
 public:
-  virtual ~MaterialSceneObject() { delete material; }
+  virtual const Material& getMaterial() const;
+  virtual void setMaterial(const Material& m);
 
-  virtual const Material& getMaterial() const { return *material; }
-  virtual void setMaterial(Material* m)	{ delete material; material = m; }
+  int getMaterialId() const { return materialId; }
 
 protected:
- MaterialSceneObject(Scene *scene, Material *mat) 
-   : SceneObject(scene), material(mat) {}
+  MaterialSceneObject(Scene *scene, const Material& mat);
+  MaterialSceneObject(Scene *scene, int matId)
+    : SceneObject(scene), materialId(matId) {}
 
-  Material* material;
+  int materialId;
 };
 
 
@@ -233,19 +290,24 @@ class KdTree{
         int depth;
         BoundingBox bbox;
         std::vector <Geometry*> objects;
+        std::vector <BoundingBox4> boxes;   // objects' bounds, four at a time
         double split;
         int size;
+        // objects are already in the space the tree's rays are in, as
+        // the faces of a trimesh are, so skip their transforms
+        bool objectSpace;
         
     public:
 //TransformNode *transform;
 
         KdTree* left;
         KdTree* right;
-        KdTree (int depth, BoundingBox bbox, int size) {
+        KdTree (int depth, BoundingBox bbox, int size, bool objectSpace = false) {
           this->bbox = bbox;
           this->depth = depth;
           currentAxis = 0;
           this->size = size;
+          this->objectSpace = objectSpace;
           left = nullptr;
           right = nullptr;
         }
@@ -266,9 +328,20 @@ class KdTree{
           this->currentAxis = currentAxis;
         }
 
+        void setLeafObjects(std::vector<Geometry*> &objects) {
+          this->objects = objects;
+          boxes.assign((objects.size() + 3) / 4, BoundingBox4());
+          for (size_t k = 0; k < objects.size(); ++k) {
+            if (objects[k]->hasBoundingBoxCapability())
+              boxes[k / 4].set(k % 4, objects[k]->getBoundingBox());
+            else
+              boxes[k / 4].setInfinite(k % 4);
+          }
+        }
+
         void addObjects (std::vector<Geometry*> &objects) {
             if (objects.size() < size || depth <= 0) {
-              this->objects = objects;
+              setLeafObjects(objects);
               return;
             }
 
@@ -305,7 +378,7 @@ class KdTree{
 
             //trim leaves
             if (countLeft == 0 || countLeft == objects.size()) {//mark
-              this->objects = objects;
+              setLeafObjects(objects);
               return;
             }
 
@@ -315,18 +388,20 @@ class KdTree{
             split_max[currentAxis] = split;
             
             // recursively build tree
-            left = new KdTree(depth - 1, BoundingBox(bbox.getMin(), split_max), size);
+            left = new KdTree(depth - 1, BoundingBox(bbox.getMin(), split_max), size, objectSpace);
             left->setCurrentAxis((currentAxis + 1) % 3);
             left->addObjects(left_objects);
-            right = new KdTree(depth - 1, BoundingBox(split_min, bbox.getMax()), size);
+            right = new KdTree(depth - 1, BoundingBox(split_min, bbox.getMax()), size, objectSpace);
             right->setCurrentAxis((currentAxis + 1) % 3);
             right->addObjects(right_objects);
       }
 
 
     bool intersect(ray& r, isect& i) {
-        double tmin = 0.0;
-        double tmax = 0.0;
+        Scalar tmin = 0.0;
+        Scalar tmax = 0.0;
+        RayCounters& stats = RenderStats::local();
+        stats.nodeVisits++;
         // get intersection time
         if(!bbox.intersect(r, tmin, tmax)){
           return false;
@@ -334,14 +409,24 @@ class KdTree{
 
         bool have_one = false;
 
-        // only leaves have objects
-        std::vector<Geometry*>::iterator obj;
-        for( obj = objects.begin(); obj != objects.end(); ++obj ){
-            isect cur;
-            if ((*obj)->intersect(r, cur)) {//Local
-                if (!have_one || (cur.t < i.t)) {
-                    i = cur;
-                    have_one = true;
+        // only leaves have objects; cull them four boxes at a time,
+        // skipping any box that starts beyond the closest hit so far
+        for (size_t base = 0; base < objects.size(); base += 4) {
+            Scalar tNear[4];
+            Scalar tLimit = have_one ? i.t : std::numeric_limits<Scalar>::max();
+            int hits = boxes[base / 4].intersect(r, tLimit, tNear);
+            for (size_t k = base; hits; ++k, hits >>= 1) {
+                if (!(hits & 1)) continue;
+                isect cur;
+                stats.primitiveTests++;
+                bool hit = objectSpace ? objects[k]->intersectLocal(r, cur)
+                                       : objects[k]->intersectCulled(r, cur);
+                if (hit) {
+                    stats.primitiveHits++;
+                    if (!have_one || (cur.t < i.t)) {
+                        i = cur;
+                        have_one = true;
+                    }
                 }
             }
         }
@@ -354,8 +439,8 @@ class KdTree{
         }
 
         // get intersection point
-        double min = r.at(tmin)[currentAxis];
-        double max = r.at(tmax)[currentAxis];
+        Scalar min = r.at(tmin)[currentAxis];
+        Scalar max = r.at(tmax)[currentAxis];
 
         // traversal
         if (min <= max + RAY_EPSILON && max - RAY_EPSILON <= split) { 
@@ -393,6 +478,9 @@ class KdTree{
 
 class Scene {
 
+  // Declared first so it outlives everything that is allocated from it.
+  MemoryArena arena;
+
 public:
   typedef std::vector<Light*>::iterator	liter;
   typedef std::vector<Light*>::const_iterator cliter;
@@ -401,20 +489,27 @@ public:
 
   TransformRoot transformRoot;
 
-  Scene() : transformRoot(), objects(), lights() {}
+  Scene();
   virtual ~Scene();
 
   void add( Geometry* obj ) {
     obj->ComputeBoundingBox();
 	sceneBounds.merge(obj->getBoundingBox());
+    if (obj->isMoving()) motion = true;
     objects.push_back(obj);
   }
-  void add(Light* light) { lights.push_back(light); }
+  void add(Light* light);
 
   bool intersect(ray& r, isect& i) const;
 
   std::vector<Light*>::const_iterator beginLights() const { return lights.begin(); }
   std::vector<Light*>::const_iterator endLights() const { return lights.end(); }
+  const std::vector<LightRecord>& getLightRecords() const { return lightRecords; }
+
+  // For sampling a few point lights per hit instead of visiting them all.
+  // Call once all the lights have been added.
+  void buildLightTree() { lightTree.build(lightRecords); }
+  const LightTree& getLightTree() const { return lightTree; }
 
   std::vector<Geometry*>::const_iterator beginObjects() const { return objects.begin(); }
   std::vector<Geometry*>::const_iterator endObjects() const { return objects.end(); }
@@ -437,29 +532,67 @@ public:
 
   const BoundingBox& bounds() const { return sceneBounds; }
 
+  // Whether anything moves while the shutter is open, so that sampling
+  // a pixel at more than one time would make a difference.
+  bool hasMotion() const { return motion; }
+
+  // Geometry, materials and transform nodes live as long as the scene
+  // does, so they are created here rather than with new.
+  MemoryArena& getArena() { return arena; }
+
+  // Different for every Scene the process creates, so per-thread caches
+  // can tell when the scene they were filled from is gone.
+  unsigned long getGeneration() const { return generation; }
+
+  // Every distinct material in the scene, shared by all objects using it.
+  int internMaterial(const Material& m) { return materials.intern(m); }
+  const Material& getMaterial(int id) const { return materials[id]; }
+  int numMaterials() const { return materials.size(); }
+  bool hasTransmissive() const { return materials.anyTransmissive(); }
+
   void buildKdTree(int depth, int size){
+    TIMELINE_SCOPE("build kd-tree");
     giter g;
     for( g = objects.begin(); g != objects.end(); ++g ){
       (*g)->buildKdTree();
     }
+    kdDepth = depth;
+    kdLeafSize = size;
     kdtree = new KdTree(depth, sceneBounds, size);
     kdtree->addObjects(objects);
   }
 
+  // Used instead of the kd-tree when transforms are going to move: it
+  // can be refit where the kd-tree has to be built again.
+  void buildBvh();
+
+  // Bring the objects' bounds and the acceleration structure up to date
+  // after TransformNode::setLocalTransform().  A BVH is refit, and built
+  // again only if that makes it more than maxGrowth times as costly; a
+  // kd-tree is always built again.  Returns true if the structure was
+  // built again.
+  bool updateTransforms(double maxGrowth = 1.5);
+
 
  private:
   std::vector<Geometry*> objects;
   std::vector<Geometry*> nonboundedobjects;
   std::vector<Geometry*> boundedobjects;
   std::vector<Light*> lights;
+  std::vector<LightRecord> lightRecords;   // parallel to lights
+  unsigned long generation;
+  bool motion;
+  LightTree lightTree;
   Camera camera;
 
   // This is the total amount of ambient light in the scene
   // (used as the I_a in the Phong shading model)
   Vec3d ambientIntensity;
 
-  typedef std::map< std::string, TextureMap* > tmap;
+  typedef std::map< std::string, std::shared_ptr<TextureMap> > tmap;
   tmap textureCache;
+
+  MaterialTable materials;
 	
   // Each object in the scene, provided that it has hasBoundingBoxCapability(),
   // must fall within this bounding box.  Objects that don't have hasBoundingBoxCapability()
@@ -468,6 +601,9 @@ public:
   
   //KdTree<Geometry>* kdtree;
   KdTree* kdtree;
+  int kdDepth, kdLeafSize;   // what it was built with
+
+  Bvh bvh;
 
 
 
@@ -476,4 +612,15 @@ public:
   mutable std::vector<std::pair<ray*, isect*> > intersectCache;
 };
 
+inline MaterialSceneObject::MaterialSceneObject(Scene *scene, const Material& mat)
+  : SceneObject(scene), materialId(scene->internMaterial(mat)) {}
+
+inline const Material& MaterialSceneObject::getMaterial() const {
+  return scene->getMaterial(materialId);
+}
+
+inline void MaterialSceneObject::setMaterial(const Material& m) {
+  materialId = scene->internMaterial(m);
+}
+
 #endif // __SCENE_H__
@@ -0,0 +1,55 @@
+#include "taskPool.h"
+
+#include <algorithm>
+
+using namespace std;
+
+TaskPool& TaskPool::instance()
+{
+	static TaskPool pool( max( 2, (int) thread::hardware_concurrency() ) );
+	return pool;
+}
+
+TaskPool::TaskPool( int threads ) : stopping( false )
+{
+	for( int i = 0; i < threads; i++ )
+		workers.push_back( thread( &TaskPool::work, this ) );
+}
+
+TaskPool::~TaskPool()
+{
+	{
+		lock_guard<mutex> guard( lock );
+		stopping = true;
+	}
+	wake.notify_all();
+	for( size_t i = 0; i < workers.size(); i++ )
+		workers[i].join();
+}
+
+future<void> TaskPool::submit( function<void()> job )
+{
+	packaged_task<void()> task( job );
+	future<void> done = task.get_future();
+	{
+		lock_guard<mutex> guard( lock );
+		queue.push_back( move( task ) );
+	}
+	wake.notify_one();
+	return done;
+}
+
+void TaskPool::work()
+{
+	for( ;; ) {
+		packaged_task<void()> task;
+		{
+			unique_lock<mutex> guard( lock );
+			while( queue.empty() && !stopping ) wake.wait( guard );
+			if( queue.empty() ) return;
+			task = move( queue.front() );
+			queue.pop_front();
+		}
+		task();
+	}
+}
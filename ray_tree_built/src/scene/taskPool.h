@@ -0,0 +1,47 @@
+//
+// taskPool.h
+//
+// A small set of worker threads for jobs that can run in the background
+// while the main thread gets on with something else, such as decoding
+// textures while the parser and kd-tree builder run.
+//
+
+#ifndef __TASKPOOL_H__
+#define __TASKPOOL_H__
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class TaskPool {
+public:
+	static TaskPool& instance();
+
+	// Queue a job.  The future becomes ready when it has run, and
+	// rethrows from get() anything the job threw.
+	std::future<void> submit( std::function<void()> job );
+
+	int numThreads() const { return (int) workers.size(); }
+
+	// Runs every job still queued before returning.
+	~TaskPool();
+
+private:
+	explicit TaskPool( int threads );
+	TaskPool( const TaskPool& );
+	TaskPool& operator=( const TaskPool& );
+
+	void work();
+
+	std::vector<std::thread> workers;
+	std::deque< std::packaged_task<void()> > queue;
+	std::mutex lock;
+	std::condition_variable wake;
+	bool stopping;
+};
+
+#endif // __TASKPOOL_H__
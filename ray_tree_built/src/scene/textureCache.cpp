@@ -0,0 +1,107 @@
+#include "textureCache.h"
+
+#include <sys/stat.h>
+#include <cstdlib>
+#include <climits>
+
+using namespace std;
+
+// Enough for a few dozen large textures; set it lower on small machines.
+static const size_t DEFAULT_BUDGET = 512u * 1024u * 1024u;
+
+// The same file reached through different relative paths should share
+// one entry.  Paths that cannot be resolved are used as given and left
+// for the TextureMap constructor to report.
+static string canonicalPath( const string& filename )
+{
+#ifdef _WIN32
+	char buf[_MAX_PATH];
+	if( _fullpath( buf, filename.c_str(), _MAX_PATH ) ) return string( buf );
+#else
+	char buf[PATH_MAX];
+	if( realpath( filename.c_str(), buf ) ) return string( buf );
+#endif
+	return filename;
+}
+
+static time_t modificationTime( const string& path )
+{
+	struct stat st;
+	if( stat( path.c_str(), &st ) != 0 ) return 0;
+	return st.st_mtime;
+}
+
+TextureCache& TextureCache::instance()
+{
+	static TextureCache cache;
+	return cache;
+}
+
+TextureCache::TextureCache() : budget( DEFAULT_BUDGET ), used( 0 ) {}
+
+shared_ptr<TextureMap> TextureCache::acquire( const string& filename )
+{
+	string path = canonicalPath( filename );
+	time_t mtime = modificationTime( path );
+
+	lock_guard<mutex> guard( lock );
+	map<string, lru::iterator>::iterator found = byPath.find( path );
+	if( found != byPath.end() ) {
+		lru::iterator e = found->second;
+		if( e->mtime == mtime ) {
+			entries.splice( entries.begin(), entries, e );
+			return e->texture;
+		}
+		// changed on disk; anyone still holding the old image keeps it
+		eraseLocked( e );
+	}
+
+	shared_ptr<TextureMap> texture = make_shared<TextureMap>( path );
+	Entry entry;
+	entry.path = path;
+	entry.mtime = mtime;
+	entry.bytes = texture->memoryUsed();
+	entry.texture = texture;
+	entries.push_front( entry );
+	byPath[path] = entries.begin();
+	used += entry.bytes;
+	trimLocked();
+	return texture;
+}
+
+void TextureCache::trim()
+{
+	lock_guard<mutex> guard( lock );
+	trimLocked();
+}
+
+void TextureCache::clear()
+{
+	lock_guard<mutex> guard( lock );
+	entries.clear();
+	byPath.clear();
+	used = 0;
+}
+
+void TextureCache::setBudget( size_t bytes )
+{
+	lock_guard<mutex> guard( lock );
+	budget = bytes;
+	trimLocked();
+}
+
+void TextureCache::trimLocked()
+{
+	lru::iterator e = entries.end();
+	while( used > budget && e != entries.begin() ) {
+		--e;
+		if( e->texture.use_count() == 1 ) eraseLocked( e++ );
+	}
+}
+
+void TextureCache::eraseLocked( lru::iterator e )
+{
+	used -= e->bytes;
+	byPath.erase( e->path );
+	entries.erase( e );
+}
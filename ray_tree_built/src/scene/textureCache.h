@@ -0,0 +1,70 @@
+//
+// textureCache.h
+//
+// One place for every decoded texture in the process, so scenes that are
+// reloaded, and the cube map, share images instead of decoding them again.
+//
+
+#ifndef __TEXTURECACHE_H__
+#define __TEXTURECACHE_H__
+
+#include <cstddef>
+#include <ctime>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "material.h"
+
+/*
+  Textures are keyed by their canonical path and the file's modification
+  time, so an image that is edited on disk is decoded again the next time
+  a scene asks for it, while an unchanged one is handed straight back.
+
+  The cache hands out shared_ptrs; whoever holds one (a Scene, the cube
+  map) keeps the image alive.  Images nobody else holds stay in the cache,
+  least recently used first out, for as long as the decoded size of
+  everything the cache knows about fits in the budget.  Images in use are
+  never evicted, so the budget can be overshot while they are.
+*/
+class TextureCache {
+public:
+	static TextureCache& instance();
+
+	// Throws TextureMapException if the image cannot be loaded.
+	std::shared_ptr<TextureMap> acquire( const std::string& filename );
+
+	// Drop unused images until the cache is within budget.
+	void trim();
+	void clear();
+
+	void setBudget( size_t bytes );
+	size_t getBudget() const { return budget; }
+	size_t bytesUsed() const { return used; }
+
+private:
+	struct Entry {
+		std::string path;
+		time_t mtime;
+		size_t bytes;
+		std::shared_ptr<TextureMap> texture;
+	};
+	typedef std::list<Entry> lru;          // most recently used at the front
+
+	TextureCache();
+	TextureCache( const TextureCache& );
+	TextureCache& operator=( const TextureCache& );
+
+	void trimLocked();
+	void eraseLocked( lru::iterator e );
+
+	lru entries;
+	std::map<std::string, lru::iterator> byPath;
+	size_t budget;
+	size_t used;
+	std::mutex lock;
+};
+
+#endif // __TEXTURECACHE_H__
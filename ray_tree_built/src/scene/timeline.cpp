@@ -0,0 +1,86 @@
+#include "timeline.h"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+atomic<bool> Timeline::on( false );
+
+// Enough for every span of a long render; past that the oldest go.
+static const size_t RING_SIZE = 1 << 14;
+
+struct Span {
+	const char* name;
+	long long start, end;
+};
+
+// Written only by its own thread.  count is published with release order
+// after each span, so a reader that loads it with acquire sees whole spans.
+struct Ring {
+	Span spans[RING_SIZE];
+	atomic<size_t> count;
+	int thread;
+};
+
+// Rings outlive their threads, so a trace still shows work done by threads
+// that have since exited.  The lock is taken once per thread, to join.
+static mutex ringsLock;
+static vector< unique_ptr<Ring> > rings;
+static thread_local Ring* threadRing = 0;
+
+static const chrono::steady_clock::time_point epoch = chrono::steady_clock::now();
+
+long long Timeline::now()
+{
+	// never 0, which TimelineScope takes to mean "not recording"
+	return chrono::duration_cast<chrono::nanoseconds>( chrono::steady_clock::now() - epoch ).count() + 1;
+}
+
+void Timeline::record( const char* name, long long start, long long end )
+{
+	Ring* ring = threadRing;
+	if( !ring ) {
+		unique_ptr<Ring> r( new Ring() );
+		r->count.store( 0 );
+		ring = threadRing = r.get();
+		lock_guard<mutex> guard( ringsLock );
+		ring->thread = (int) rings.size() + 1;
+		rings.push_back( move( r ) );
+	}
+	size_t n = ring->count.load( memory_order_relaxed );
+	Span& s = ring->spans[n % RING_SIZE];
+	s.name = name;
+	s.start = start;
+	s.end = end;
+	ring->count.store( n + 1, memory_order_release );
+}
+
+bool Timeline::write( const char* filename )
+{
+	FILE* f = fopen( filename, "w" );
+	if( !f ) return false;
+
+	fprintf( f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n" );
+	fprintf( f, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"ray\"}}" );
+	lock_guard<mutex> guard( ringsLock );
+	for( size_t k = 0; k < rings.size(); ++k ) {
+		const Ring& ring = *rings[k];
+		fprintf( f, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, "
+			"\"args\": {\"name\": \"thread %d\"}}", ring.thread, ring.thread );
+		size_t count = ring.count.load( memory_order_acquire );
+		size_t first = count > RING_SIZE ? count - RING_SIZE : 0;
+		for( size_t n = first; n < count; ++n ) {
+			const Span& s = ring.spans[n % RING_SIZE];
+			// trace times are in microseconds
+			fprintf( f, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, "
+				"\"ts\": %.3f, \"dur\": %.3f}", s.name, ring.thread,
+				s.start / 1000.0, ( s.end - s.start ) / 1000.0 );
+		}
+	}
+	fprintf( f, "\n]}\n" );
+	return fclose( f ) == 0;
+}
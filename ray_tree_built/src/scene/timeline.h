@@ -0,0 +1,64 @@
+//
+// timeline.h
+//
+// Scoped timers for the coarse stages of a render -- parsing, texture
+// decoding, kd-tree building, tracing, writing the image -- recorded per
+// thread and written out as a Chrome trace (chrome://tracing, Perfetto).
+//
+// Put TIMELINE_SCOPE("name") at the top of a block to time it.  Nothing
+// is recorded unless Timeline::enable() has been called, and building with
+// -DRAY_NO_TIMELINE removes the timers altogether.
+//
+
+#ifndef __TIMELINE_H__
+#define __TIMELINE_H__
+
+#include <atomic>
+
+class Timeline {
+public:
+	static void enable() { on = true; }
+	static bool enabled() { return on; }
+
+	// Nanoseconds since the process started.
+	static long long now();
+
+	// Record a finished span on this thread's ring.  name must outlive the
+	// process, as string literals do.
+	static void record( const char* name, long long start, long long end );
+
+	// Write every thread's spans as Chrome trace JSON.  Call once the
+	// threads being traced are idle; returns false if the file can't be
+	// written.
+	static bool write( const char* filename );
+
+private:
+	static std::atomic<bool> on;
+};
+
+class TimelineScope {
+public:
+	explicit TimelineScope( const char* n )
+		: name( n ), start( Timeline::enabled() ? Timeline::now() : 0 ) {}
+	~TimelineScope()
+	{
+		if( start ) Timeline::record( name, start, Timeline::now() );
+	}
+
+private:
+	TimelineScope( const TimelineScope& );
+	TimelineScope& operator=( const TimelineScope& );
+
+	const char* name;
+	long long start;
+};
+
+#ifdef RAY_NO_TIMELINE
+#define TIMELINE_SCOPE( name )
+#else
+#define TIMELINE_JOIN2( a, b ) a##b
+#define TIMELINE_JOIN( a, b ) TIMELINE_JOIN2( a, b )
+#define TIMELINE_SCOPE( name ) TimelineScope TIMELINE_JOIN( timelineScope, __LINE__ )( name )
+#endif
+
+#endif // __TIMELINE_H__
@@ -1,16 +1,50 @@
 #include <iostream>
 #include <time.h>
 #include <stdarg.h>
+#include <string.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <iomanip>
+#include <sstream>
 
 #include <assert.h>
 
 #include "CommandLineUI.h"
 #include "../fileio/bitmap.h"
+#include "../fileio/imageWriter.h"
+#include "../scene/taskPool.h"
+#include "../scene/renderStats.h"
+#include "../scene/timeline.h"
+#include "../scene/cameraPath.h"
+#include "../scene/scene.h"
+#include "GraphicalUI.h"
 
 #include "../RayTracer.h"
 
 using namespace std;
 
+// Rows traced, and handed to the image writer, at a time.
+static const int BAND_ROWS = 16;
+
+// Edge of the tiles a frame is shared out in by -p.
+static const int TILE_SIZE = 32;
+
+// Copy the rows rows of frame from top - 1 down into band, top row first,
+// as the image writers want them.
+static void copyBand( const FrameBuffer& frame, int top, int rows, vector<float>& band )
+{
+	int width = frame.getWidth();
+	band.resize( 3 * width * rows );
+	for( int r = 0; r < rows; ++r )
+		for( int i = 0; i < width; ++i ) {
+			Vec3d c = frame.color( i, top - 1 - r );
+			float* p = &band[3 * ( width * r + i )];
+			p[0] = float( c[0] );
+			p[1] = float( c[1] );
+			p[2] = float( c[2] );
+		}
+}
+
 // The command line UI simply parses out all the arguments off
 // the command line and stores them locally.
 CommandLineUI::CommandLineUI( int argc, char* const* argv )
@@ -19,8 +53,12 @@ CommandLineUI::CommandLineUI( int argc, char* const* argv )
 	int i;
 
 	progName=argv[0];
+	traceName=0;
+	tilePart=0;
+	tileParts=0;
+	cameraPathName=0;
 
-	while( (i = getopt( argc, argv, "tr:w:h:" )) != EOF )
+	while( (i = getopt( argc, argv, "tr:w:h:l:m:dsc:bBT:p:a:" )) != EOF )
 	{
 		switch( i )
 		{
@@ -31,6 +69,61 @@ CommandLineUI::CommandLineUI( int argc, char* const* argv )
 			case 'w':
 				m_nSize = atoi( optarg );
 				break;
+
+			case 'l':
+				m_nLightSamples = atoi( optarg );
+				break;
+
+			case 'm':
+				m_nMotionSamples = atoi( optarg );
+				break;
+
+			case 'd':
+				m_deferred = true;
+				break;
+
+			case 's':
+				m_stats = true;
+				break;
+
+			case 'p':
+				if( sscanf( optarg, "%d/%d", &tilePart, &tileParts ) != 2
+					|| tileParts < 1 || tilePart < 0 || tilePart >= tileParts ) {
+					std::cerr << "Bad part '" << optarg << "'; expected k/n with 0 <= k < n." << std::endl;
+					usage();
+					exit(1);
+				}
+				break;
+
+			case 'a':
+				cameraPathName = optarg;
+				break;
+
+			case 'T':
+				traceName = optarg;
+				Timeline::enable();
+				break;
+
+			case 'b':
+				// the reference the accelerated paths are checked against
+				GraphicalUI::m_kdtreeInfo = false;
+				break;
+
+			case 'B':
+				m_bvh = true;
+				break;
+
+			case 'c':
+				if( !strcmp( optarg, "steps" ) )
+					m_costMetric = COST_STEPS;
+				else if( !strcmp( optarg, "ns" ) )
+					m_costMetric = COST_NANOSECONDS;
+				else {
+					std::cerr << "Unknown cost metric '" << optarg << "'." << std::endl;
+					usage();
+					exit(1);
+				}
+				break;
 			default:
 			// Oops; unknown argument
 			std::cerr << "Invalid argument: '" << i << "'." << std::endl;
@@ -45,6 +138,24 @@ CommandLineUI::CommandLineUI( int argc, char* const* argv )
 		exit(1);
 	}
 
+	if( tileParts && m_deferred )
+	{
+		std::cerr << "-d shades the whole frame at once and can't be combined with -p." << std::endl;
+		exit(1);
+	}
+
+	if( m_deferred && m_nMotionSamples > 1 )
+	{
+		std::cerr << "-d shades one sample per pixel and can't be combined with -m." << std::endl;
+		exit(1);
+	}
+
+	if( cameraPathName && ( tileParts || m_costMetric != NO_COST ) )
+	{
+		std::cerr << "-a renders whole frames and can't be combined with -p or -c." << std::endl;
+		exit(1);
+	}
+
 	rayName = argv[optind];
 	imgName = argv[optind+1];
 }
@@ -59,30 +170,101 @@ int CommandLineUI::run()
 		int width = m_nSize;
 		int height = (int)(width / raytracer->aspectRatio() + 0.5);
 
+		if( m_deferred && m_nDepth > RayTracer::maxDeferredDepth( width, height ) ) {
+			std::cerr << "-d can trace at most " << RayTracer::maxDeferredDepth( width, height )
+				<< " levels deep at " << width << "x" << height << "; use a smaller -r." << std::endl;
+			return 1;
+		}
+
 		raytracer->traceSetup( width, height );
+		RenderStats::reset();
+
+		if( cameraPathName ) {
+			clock_t start = clock();
+			int status = renderAnimation( width, height );
+			if( status ) return status;
+			double t = (double)(clock() - start) / CLOCKS_PER_SEC;
+			std::cout << "total time = " << t << " seconds" << std::endl;
+			if( m_stats ) RenderStats::report( std::cout );
+			if( traceName && !Timeline::write( traceName ) )
+				std::cerr << "Unable to write trace file '" << traceName << "'" << std::endl;
+			return status;
+		}
+
+		// .png and .exr are written a band at a time as the image is traced;
+		// with -p the output is a partial frame instead
+		ImageWriter* out = 0;
+		if( !tileParts && ImageWriter::handles( imgName ) ) {
+			out = ImageWriter::open( imgName, width, height );
+			if( !out ) {
+				std::cerr << "Unable to write image file '" << imgName << "'" << std::endl;
+				return 1;
+			}
+		}
 
 		clock_t start, end;
 		start = clock();
 
-		for( int j = 0; j < height; ++j )
-			for( int i = 0; i < width; ++i )
-				raytracer->tracePixel(i,j);
+		if( tileParts )
+			traceTiles( width, height );
+		else if( m_deferred ) {
+			raytracer->traceDeferred();
+			if( out ) {
+				TIMELINE_SCOPE( "write image" );
+				vector<float> band;
+				for( int top = height; top > 0; top -= BAND_ROWS ) {
+					int rows = min( BAND_ROWS, top );
+					copyBand( raytracer->getFrame(), top, rows, band );
+					out->writeRows( &band[0], rows );
+				}
+			}
+		}
+		else
+			traceBands( out, width, height );
 
 		end=clock();
 
 		// save image
-		unsigned char* buf;
+		if( tileParts ) {
+			TIMELINE_SCOPE( "write image" );
+			if( !raytracer->getFrame().savePartial( imgName, myTiles( width, height ) ) ) {
+				std::cerr << "Unable to write partial frame '" << imgName << "'" << std::endl;
+				return 1;
+			}
+		} else if( out ) {
+			bool written = out->close();
+			delete out;
+			if( !written ) {
+				std::cerr << "Unable to write image file '" << imgName << "'" << std::endl;
+				return 1;
+			}
+		} else {
+			unsigned char* buf;
 
-		raytracer->getBuffer(buf, width, height);
+			raytracer->getBuffer(buf, width, height);
 
-		if (buf)
-			writeBMP(imgName, width, height, buf);
+			if (buf) {
+				TIMELINE_SCOPE( "write image" );
+				writeBMP(imgName, width, height, buf);
+			}
+		}
+
+		// the heatmap goes next to the image: out.bmp -> out_cost.bmp
+		if( m_costMetric != NO_COST ) {
+			string costName( imgName );
+			size_t dot = costName.find_last_of( '.' );
+			size_t slash = costName.find_last_of( "\\/" );
+			if( dot != string::npos && ( slash == string::npos || dot > slash ) )
+				costName.erase( dot );
+			costName += "_cost.bmp";
+			raytracer->writeCostImage( costName.c_str() );
+		}
 
 		double t=(double)(end-start)/CLOCKS_PER_SEC;
-		//int totalRays = TraceUI::resetCount();
-		//std::cout << "total time = " << t << " seconds, rays traced = " << totalRays << std::endl;
-		//std::cout << "total time = " << t << " seconds, rays traced = " << totalRays << std::endl;
 		std::cout << "total time = " << t << " seconds" << std::endl;
+		if( m_stats ) RenderStats::report( std::cout );
+		if( traceName && !Timeline::write( traceName ) )
+			std::cerr << "Unable to write trace file '" << traceName << "'" << std::endl;
 
         return 0;
 	}
@@ -93,6 +275,132 @@ int CommandLineUI::run()
 	}
 }
 
+// Trace the image from the top row down, BAND_ROWS rows at a time.  With
+// an out, each band's colors are written on the task pool while
+// the next band is traced; two band buffers take turns, so the one being
+// traced into is never the one being written.
+void CommandLineUI::traceBands( ImageWriter* out, int width, int height )
+{
+	vector<float> bands[2];
+	future<void> writing;
+	for( int top = height, k = 0; top > 0; top -= BAND_ROWS, k ^= 1 ) {
+		int rows = min( BAND_ROWS, top );
+		{
+			TIMELINE_SCOPE( "trace band" );
+			for( int r = 0; r < rows; ++r )
+				for( int i = 0; i < width; ++i )
+					raytracer->tracePixel( i, top - 1 - r );
+		}
+		if( out ) {
+			vector<float>& band = bands[k];
+			copyBand( raytracer->getFrame(), top, rows, band );
+			if( writing.valid() ) writing.wait();
+			const float* rgb = &band[0];
+			writing = TaskPool::instance().submit( [out, rgb, rows]() {
+				TIMELINE_SCOPE( "write band" );
+				out->writeRows( rgb, rows );
+			} );
+		}
+	}
+	if( writing.valid() ) writing.wait();
+}
+
+// This process's share of the tiles: every tileParts'th, from tilePart,
+// which spreads the expensive parts of most images over the processes.
+vector<FrameBuffer::Tile> CommandLineUI::myTiles( int width, int height ) const
+{
+	vector<FrameBuffer::Tile> all = FrameBuffer::tiles( width, height, TILE_SIZE ), mine;
+	for( size_t t = tilePart; t < all.size(); t += tileParts )
+		mine.push_back( all[t] );
+	return mine;
+}
+
+void CommandLineUI::traceTiles( int width, int height )
+{
+	vector<FrameBuffer::Tile> tiles = myTiles( width, height );
+	for( size_t t = 0; t < tiles.size(); ++t ) {
+		TIMELINE_SCOPE( "trace tile" );
+		const FrameBuffer::Tile& tile = tiles[t];
+		for( int j = tile.y; j < tile.y + tile.height; ++j )
+			for( int i = tile.x; i < tile.x + tile.width; ++i )
+				raytracer->tracePixel( i, j );
+	}
+}
+
+// The name of frame's image: pattern with a printf-style %d, %04d and so
+// on replaced by the frame number, or if it has none, with _ and the
+// number padded to four digits before the extension.
+static string frameName( const char* pattern, int frame )
+{
+	string name( pattern );
+	int digits = 4;
+	size_t at = name.find( '%' );
+	if( at != string::npos ) {
+		size_t end = at + 1;
+		while( end < name.size() && isdigit( name[end] ) ) ++end;
+		if( end < name.size() && name[end] == 'd' ) {
+			digits = atoi( name.c_str() + at + 1 );
+			name.erase( at, end + 1 - at );
+		} else
+			at = string::npos;
+	}
+	if( at == string::npos ) {
+		size_t dot = name.find_last_of( '.' );
+		size_t slash = name.find_last_of( "\\/" );
+		at = dot != string::npos && ( slash == string::npos || dot > slash ) ? dot : name.size();
+		name.insert( at++, "_" );
+	}
+	ostringstream number;
+	number << setw( digits ) << setfill( '0' ) << frame;
+	name.insert( at, number.str() );
+	return name;
+}
+
+// Render every frame of the camera path to its own image.  The scene is
+// parsed and its kd-tree built once, by run(), for all of them, and each
+// frame is written on the task pool while the next one is traced.
+int CommandLineUI::renderAnimation( int width, int height )
+{
+	try {
+		CameraPath path( cameraPathName );
+		Camera& camera = raytracer->scene->getCamera();
+
+		FrameBuffer finished;
+		string name, failed;
+		future<void> writing;
+		for( int frame = path.firstFrame(); frame <= path.lastFrame(); ++frame ) {
+			path.apply( frame, camera );
+			raytracer->traceSetup( width, height );
+			{
+				TIMELINE_SCOPE( "trace frame" );
+				if( m_deferred )
+					raytracer->traceDeferred();
+				else
+					traceBands( 0, width, height );
+			}
+
+			if( writing.valid() ) writing.wait();
+			if( !failed.empty() ) break;
+			finished = raytracer->getFrame();
+			name = frameName( imgName, frame );
+			writing = TaskPool::instance().submit( [&finished, &failed, name]() {
+				TIMELINE_SCOPE( "write frame" );
+				if( !finished.save( name.c_str() ) ) failed = name;
+			} );
+		}
+		if( writing.valid() ) writing.wait();
+		if( !failed.empty() ) {
+			std::cerr << "Unable to write image file '" << failed << "'" << std::endl;
+			return 1;
+		}
+	}
+	catch( CameraPathException& e ) {
+		std::cerr << e.message() << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
 void CommandLineUI::alert( const string& msg )
 {
 	std::cerr << msg << std::endl;
@@ -101,6 +409,26 @@ void CommandLineUI::alert( const string& msg )
 void CommandLineUI::usage()
 {
 	std::cerr << "usage: " << progName << " [options] [input.ray output.bmp]" << std::endl;
+	std::cerr << "  output may also be .png, or .exr for unclamped float color; both are" << std::endl;
+	std::cerr << "  written a band of rows at a time as the image is traced" << std::endl;
 	std::cerr << "  -r <#>      set recursion level (default " << m_nDepth << ")" << std::endl; 
 	std::cerr << "  -w <#>      set output image width (default " << m_nSize << ")" << std::endl;
+	std::cerr << "  -l <#>      sample this many point lights per hit (default 0, all)" << std::endl;
+	std::cerr << "  -m <#>      motion blur: trace each pixel at this many times spread over" << std::endl;
+	std::cerr << "              the shutter, if anything in the scene moves (default 1)" << std::endl;
+	std::cerr << "  -d          deferred shading: intersect every pixel, then shade" << std::endl;
+	std::cerr << "  -s          print ray, kd-tree node and primitive test counts" << std::endl;
+	std::cerr << "  -b          brute force: test every object, without the kd-tree" << std::endl;
+	std::cerr << "  -B          use a BVH over the objects instead of the kd-tree; unlike the" << std::endl;
+	std::cerr << "              kd-tree it is refit, not rebuilt, when transforms change" << std::endl;
+	std::cerr << "  -p <k>/<n>  render only part k (from 0) of n of the frame's tiles, and write" << std::endl;
+	std::cerr << "              the output as a partial frame for ray-merge to combine" << std::endl;
+	std::cerr << "  -a <path>   render a frame for each keyframe and in-between of the camera" << std::endl;
+	std::cerr << "              path file, to output with the frame number added, or put in" << std::endl;
+	std::cerr << "              place of a %d or %04d in it; each line of the path reads" << std::endl;
+	std::cerr << "              frame px py pz vx vy vz ux uy uz fov (position, viewdir, updir)" << std::endl;
+	std::cerr << "  -T <file>   write a Chrome trace (chrome://tracing, Perfetto) of the" << std::endl;
+	std::cerr << "              parse, texture decode, kd-tree build, tracing and image write" << std::endl;
+	std::cerr << "  -c <metric> also write a heatmap of per-pixel cost to <output>_cost.bmp;" << std::endl;
+	std::cerr << "              metric is 'steps' (nodes visited + primitives tested) or 'ns'" << std::endl;
 }
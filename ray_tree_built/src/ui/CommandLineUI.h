@@ -7,7 +7,12 @@
 #ifndef __CommandLineUI_h__
 #define __CommandLineUI_h__
 
+#include <vector>
+
 #include "TraceUI.h"
+#include "../scene/frameBuffer.h"
+
+class ImageWriter;
 
 // ***********************************************************
 // from getopt.cpp
@@ -30,10 +35,17 @@ public:
 
 private:
 	void		usage();
+	void		traceBands( ImageWriter* out, int width, int height );
+	void		traceTiles( int width, int height );
+	int		renderAnimation( int width, int height );
+	std::vector<FrameBuffer::Tile>	myTiles( int width, int height ) const;
 
 	char*	rayName;
 	char*	imgName;
 	char*	progName;
+	char*	traceName;	// Chrome trace of the render's stages, or 0
+	int		tilePart, tileParts;	// render only tiles tilePart, + tileParts, ...
+	char*	cameraPathName;	// keyframes to render a sequence along, or 0
 };
 
 #endif
@@ -1,5 +1,6 @@
 #include "CubeMapChooser.h"
 #include "../scene/cubeMap.h"
+#include "../scene/textureCache.h"
 #include "../scene/material.h"
 #include "../ui/GraphicalUI.h"
 #include <iostream>
@@ -169,7 +170,7 @@ void CubeMapChooser::cb_znb(Fl_Widget* o, void* v) {
 
 void CubeMapChooser::cb_ffi(Fl_Widget* o, int i) {
 	CubeMapChooser* ch = (CubeMapChooser*)(o->parent()->user_data());
-	try { ch->cubeFace[i] = new TextureMap(ch->fi[i]->value()); }
+	try { ch->cubeFace[i] = TextureCache::instance().acquire(ch->fi[i]->value()); }
 	catch (TextureMapException &xcpt) {
 		ch->fb[i]->selection_color(FL_RED);
 		ch->fb[i]->value(0);
@@ -199,7 +200,7 @@ void CubeMapChooser::cb_ffi(Fl_Widget* o, int i) {
 void CubeMapChooser::cb_ffb(Fl_Widget* o, int i) {
 	CubeMapChooser* ch = (CubeMapChooser*)(o->parent()->user_data());
 	if (char* curPath = fl_file_chooser(ch->btnMsg[i].c_str(),  ".bmp or .png (*.{bmp,png})", ch->fn[i].c_str(), 0)) {
-		try { ch->cubeFace[i] = new TextureMap(curPath); }
+		try { ch->cubeFace[i] = TextureCache::instance().acquire(curPath); }
 		catch (TextureMapException &xcpt) {
 			ch->fb[i]->selection_color(FL_RED);
 			ch->fb[i]->value(0);
@@ -10,6 +10,7 @@
 #include <FL/Fl_Button.H>
 #include <FL/Fl_File_Chooser.H>
 #include <string>
+#include <memory>
 
 class TextureMap;
 class GraphicalUI;
@@ -22,7 +23,7 @@ class CubeMapChooser {
 	Fl_Button* cancel;
 	Fl_File_Input* fi[6];
 	Fl_Light_Button* fb[6];
-	TextureMap* cubeFace[6];
+	std::shared_ptr<TextureMap> cubeFace[6];
 	std::string fn[6];
 	std::string btnMsg[6];
 
@@ -250,6 +250,11 @@ void GraphicalUI::cb_filterSlides(Fl_Widget* o, void* v)
 	((GraphicalUI*)(o->user_data()))->m_nFilterWidth=int( ((Fl_Slider *)o)->value() ) ;
 }
 
+void GraphicalUI::cb_lightSamplesSlides(Fl_Widget* o, void* v)
+{
+	((GraphicalUI*)(o->user_data()))->m_nLightSamples=int( ((Fl_Slider *)o)->value() ) ;
+}
+
 //smooth shade
 void GraphicalUI::cb_ssCheckButton(Fl_Widget* o, void* v)
 {
@@ -264,6 +269,20 @@ void GraphicalUI::cb_shCheckButton(Fl_Widget* o, void* v)
 	pUI->m_shadows = (((Fl_Check_Button*)o)->value() == 1);
 }
 
+//deferred shading
+void GraphicalUI::cb_deferredCheckButton(Fl_Widget* o, void* v)
+{
+	pUI=(GraphicalUI*)(o->user_data());
+	pUI->m_deferred = (((Fl_Check_Button*)o)->value() == 1);
+}
+
+//ray and traversal counts, as ray -s prints them
+void GraphicalUI::cb_statsCheckButton(Fl_Widget* o, void* v)
+{
+	pUI=(GraphicalUI*)(o->user_data());
+	pUI->m_stats = (((Fl_Check_Button*)o)->value() == 1);
+}
+
 // void GraphicalUI::show_picture(const char *old_label, int width_start, int width, int height_start, int height){
 // //void* GraphicalUI::show_picture(void *threadarg){
 
@@ -311,7 +330,6 @@ void GraphicalUI::antiAliasing(int height_start, int height_end){
 
 	for( int j = height_start; j < height_end; ++j ){
 		for( int i = 0; i < width; ++i ){
-			Vec3d col = Vec3d(0, 0, 0);
 			if (stopTrace) break;
 			double x = double(i)/double(width);
 			double y = double(j)/double(height);
@@ -319,18 +337,15 @@ void GraphicalUI::antiAliasing(int height_start, int height_end){
 	 		double deltaH = 1.0 / (double) height / degree; 
 	 		// double deltaW = 1.0 / (double)degree;
 	 		// double deltaH = 1.0 / (double)degree; 
+			// the samples replace the one tracePixel took, and are averaged
+			// unclamped in the frame
+			pUI->getRayTracer()->getFrame().clearPixel(i, j);
 			for (int i1 = 0; i1 < degree; i1 ++){
 				for (int ji = 0; ji < degree; ji ++){
-					col += pUI->getRayTracer()->trace(x + deltaW * i1, y + deltaH * ji);
+					pUI->getRayTracer()->addSample(i, j, x + deltaW * i1, y + deltaH * ji,
+						RayTracer::shutterTime(i, j, i1 * int(degree) + ji, int(degree * degree)));
 				}
 			}
-
-			col /= (degree*degree);
-			unsigned char *pixel = buf + ( i + j * width ) * 3;
-
-			pixel[0] = (int)( 255.0 * min(col[0], 1.0));
-			pixel[1] = (int)( 255.0 * min(col[1], 1.0));
-			pixel[2] = (int)( 255.0 * min(col[2], 1.0));
 		}
 	}
 
@@ -353,6 +368,7 @@ void GraphicalUI::cb_render(Fl_Widget* o, void* v) {
 		pUI->m_traceGlWindow->resizeWindow(width, height);
 		pUI->m_traceGlWindow->show();
 		pUI->raytracer->traceSetup(width, height);
+		RenderStats::reset();
 
 		// Save the window label
                 const char *old_label = pUI->m_traceGlWindow->label();
@@ -360,6 +376,13 @@ void GraphicalUI::cb_render(Fl_Widget* o, void* v) {
 		clock_t now, prev;
 		now = prev = clock();
 		clock_t intervalMS = pUI->refreshInterval * 100;
+		if (pUI->m_deferred)
+		  {
+		    // no partial image to show until the whole frame is shaded
+		    pUI->raytracer->traceDeferred();
+		    pUI->m_debuggingWindow->m_debuggingView->setDirty();
+		  }
+		else
 		for (int y = 0; y < height; y++)
 		  {
 		    for (int x = 0; x < width; x++)
@@ -425,7 +448,6 @@ void GraphicalUI::cb_render(Fl_Widget* o, void* v) {
 
 				for( int j = 0; j < height; ++j ){
 					for( int i = 0; i < width; ++i ){
-						Vec3d col = Vec3d(0, 0, 0);
 						if (stopTrace) break;
 						double x = double(i)/double(width);
 						double y = double(j)/double(height);
@@ -433,17 +455,13 @@ void GraphicalUI::cb_render(Fl_Widget* o, void* v) {
 				 		double deltaH = 1.0 / (double) height / degree; 
 				 		// double deltaW = 1.0 / (double)degree;
 				 		// double deltaH = 1.0 / (double)degree; 
+						pUI->getRayTracer()->getFrame().clearPixel(i, j);
 						for (int i1 = 0; i1 < degree; i1 ++){
 							for (int ji = 0; ji < degree; ji ++){
-								col += pUI->getRayTracer()->trace(x + deltaW * i1, y + deltaH * ji);
+								pUI->getRayTracer()->addSample(i, j, x + deltaW * i1, y + deltaH * ji,
+									RayTracer::shutterTime(i, j, i1 * int(degree) + ji, int(degree * degree)));
 							}
 						}
-
-						col /= (degree*degree);
-						unsigned char *pixel = buf + ( i + j * width ) * 3;
-						pixel[0] = (int)( 255.0 * min(col[0], 1.0));
-						pixel[1] = (int)( 255.0 * min(col[1], 1.0));
-						pixel[2] = (int)( 255.0 * min(col[2], 1.0));
 					}
 				}
 
@@ -453,6 +471,8 @@ void GraphicalUI::cb_render(Fl_Widget* o, void* v) {
 
 		}
 
+		// counts for the frame, for tuning the kd-tree settings
+		if (pUI->m_stats) RenderStats::report(cout);
 	}
 }
 
@@ -661,6 +681,19 @@ GraphicalUI::GraphicalUI() : refreshInterval(10) {
 	m_filterSlider->callback(cb_filterSlides);
 	m_filterSlider->deactivate();
 
+	// install light samples slider; 0 shades with every light
+	m_lightSamplesSlider = new Fl_Value_Slider(10, 395, 180, 20, "Light Samples (0 = all)");
+	m_lightSamplesSlider->user_data((void*)(this));	// record self to be used by static callback functions
+	m_lightSamplesSlider->type(FL_HOR_NICE_SLIDER);
+	m_lightSamplesSlider->labelfont(FL_COURIER);
+	m_lightSamplesSlider->labelsize(12);
+	m_lightSamplesSlider->minimum(0);
+	m_lightSamplesSlider->maximum(32);
+	m_lightSamplesSlider->step(1);
+	m_lightSamplesSlider->value(m_nLightSamples);
+	m_lightSamplesSlider->align(FL_ALIGN_RIGHT);
+	m_lightSamplesSlider->callback(cb_lightSamplesSlides);
+
 	// set up smooth shade implementation checkbox
 	m_ssCheckButton = new Fl_Check_Button(10, 365, 80, 20, "SmoothShade");
 	m_ssCheckButton->user_data((void*)(this));
@@ -673,6 +706,20 @@ GraphicalUI::GraphicalUI() : refreshInterval(10) {
 	m_shCheckButton->callback(cb_shCheckButton);
 	m_shCheckButton->value(m_shadows);
 
+	// set up deferred shading checkbox; rendering the same scene again
+	// at the same size then only re-shades, reusing the recorded hits
+	m_deferredCheckButton = new Fl_Check_Button(250, 365, 80, 20, "Deferred");
+	m_deferredCheckButton->user_data((void*)(this));
+	m_deferredCheckButton->callback(cb_deferredCheckButton);
+	m_deferredCheckButton->value(m_deferred);
+
+	// set up stats checkbox: print the frame's ray and traversal counts
+	// to stdout after each render
+	m_statsCheckButton = new Fl_Check_Button(250, 429, 80, 20, "Stats");
+	m_statsCheckButton->user_data((void*)(this));
+	m_statsCheckButton->callback(cb_statsCheckButton);
+	m_statsCheckButton->value(m_stats);
+
 
 	m_mainWindow->callback(cb_exit2);
 	m_mainWindow->when(FL_HIDE);
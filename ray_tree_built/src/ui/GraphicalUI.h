@@ -44,6 +44,7 @@ public:
 	Fl_Slider*			m_treeDepthSlider;
 	Fl_Slider*			m_leafSizeSlider;
 	Fl_Slider*			m_filterSlider;
+	Fl_Slider*			m_lightSamplesSlider;
 	
 
 	Fl_Check_Button*	m_debuggingDisplayCheckButton;
@@ -53,6 +54,8 @@ public:
 	Fl_Check_Button*	m_ssCheckButton;
 	Fl_Check_Button*	m_shCheckButton;
 	Fl_Check_Button*	m_bfCheckButton;
+	Fl_Check_Button*	m_deferredCheckButton;
+	Fl_Check_Button*	m_statsCheckButton;
 
 	Fl_Button*			m_renderButton;
 	Fl_Button*			m_stopButton;
@@ -129,6 +132,8 @@ private:
 	static void cb_ssCheckButton(Fl_Widget* o, void* v);
 	static void cb_shCheckButton(Fl_Widget* o, void* v);
 	static void cb_bfCheckButton(Fl_Widget* o, void* v);
+	static void cb_deferredCheckButton(Fl_Widget* o, void* v);
+	static void cb_statsCheckButton(Fl_Widget* o, void* v);
 
 	//kdtree
 	static void cb_kdtreeCheckButton(Fl_Widget* o, void* v);
@@ -145,6 +150,7 @@ private:
 	//cubeMap
 	static void cb_cubeMapCheckButton(Fl_Widget* o, void* v);
 	static void cb_filterSlides(Fl_Widget* o, void* v);
+	static void cb_lightSamplesSlides(Fl_Widget* o, void* v);
 	
 	static void cb_multiThreadSlides(Fl_Widget* o, void* v);
 			
@@ -18,9 +18,13 @@ class RayTracer;
 
 class TraceUI {
 public:
+	// What the per-pixel cost image measures.
+	enum CostMetric { NO_COST, COST_STEPS, COST_NANOSECONDS };
+
 	TraceUI() : m_nDepth(0), m_nSize(512), m_displayDebuggingInfo(false),
                     m_shadows(true), m_smoothshade(true), raytracer(0),
-                    m_nFilterWidth(1) //, m_kdtreeInfo(true)//, m_nKdtreeMaxDepth(0) //kdtree
+                    m_nFilterWidth(1), m_nLightSamples(0), m_nMotionSamples(1), m_deferred(false), m_bvh(false),
+                    m_stats(false), m_costMetric(NO_COST) //, m_kdtreeInfo(true)//, m_nKdtreeMaxDepth(0) //kdtree
                     {}
 
 	virtual int	run() = 0;
@@ -37,9 +41,15 @@ public:
 	int	getSize() const { return m_nSize; }
 	int	getDepth() const { return m_nDepth; }
 	int		getFilterWidth() const { return m_nFilterWidth; }
+	int		getLightSamples() const { return m_nLightSamples; }
+	int		getMotionSamples() const { return m_nMotionSamples; }
 
 	bool	shadowSw() const { return m_shadows; }
 	bool	smShadSw() const { return m_smoothshade; }
+	bool	deferredSw() const { return m_deferred; }
+	bool	bvhSw() const { return m_bvh; }
+	bool	statsSw() const { return m_stats; }
+	CostMetric	getCostMetric() const { return m_costMetric; }
 
 
 	static bool m_debug;
@@ -53,6 +63,8 @@ protected:
 	int	m_nSize;	// Size of the traced image
 	int	m_nDepth;	// Max depth of recursion
 	int m_nFilterWidth;  // width of cubemap filter
+	int m_nLightSamples;  // point lights sampled per hit; 0 visits them all
+	int m_nMotionSamples;  // times in the shutter sampled per pixel
 	
 
 	// Determines whether or not to show debugging information
@@ -61,6 +73,10 @@ protected:
 	bool m_displayDebuggingInfo;
 	bool m_shadows;  // compute shadows?
 	bool m_smoothshade;  // turn on/off smoothshading?
+	bool m_deferred;  // intersect the whole frame, then shade it
+	bool m_bvh;  // a refittable BVH instead of the kd-tree
+	bool m_stats;  // print ray and traversal counts after rendering
+	CostMetric m_costMetric;  // write a per-pixel cost heatmap?
 	bool		m_usingCubeMap;  // render with cubemap
 	bool		m_gotCubeMap;  // cubemap defined
 	
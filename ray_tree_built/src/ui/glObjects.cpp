@@ -378,20 +378,20 @@ void Trimesh::glDrawLocal(int quality, bool actualMaterials, bool actualTextures
 			if( ! normals.empty() )
 				glNormal3dv( normals[vert1].getPointer() );
 			if( !materials.empty() && actualMaterials )
-				setGLMaterial( *materials[vert1], *itr );
-			glVertex3dv( vertices[vert1].getPointer() );
+				setGLMaterial( scene->getMaterial(materials[vert1]), *itr );
+			glVertex3dv( Vec3d( vertices[vert1] ).getPointer() );
 
 			if( ! normals.empty() )
 				glNormal3dv( normals[vert2].getPointer() );
 			if( !materials.empty() && actualMaterials )
-				setGLMaterial( *materials[vert2], *itr );
-			glVertex3dv( vertices[vert2].getPointer() );
+				setGLMaterial( scene->getMaterial(materials[vert2]), *itr );
+			glVertex3dv( Vec3d( vertices[vert2] ).getPointer() );
 
 			if( ! normals.empty() )
 				glNormal3dv( normals[vert3].getPointer() );
 			if( !materials.empty() && actualMaterials )
-				setGLMaterial( *materials[vert3], *itr );
-			glVertex3dv( vertices[vert3].getPointer() );
+				setGLMaterial( scene->getMaterial(materials[vert3]), *itr );
+			glVertex3dv( Vec3d( vertices[vert3] ).getPointer() );
 		}
 		glEnd();
 
@@ -0,0 +1,276 @@
+#ifndef __SIMD_HEADER__
+#define __SIMD_HEADER__
+
+//
+// simd.h
+//
+// Plain-old-data 3- and 4-vectors for the hot loops of the tracer.
+//
+// The Vec3<T> family in vec.h is convenient and is what the rest of the
+// code talks in, but every operator builds a fresh three-element object
+// and nothing tells the compiler it may keep a vector in one register.
+// The types here are trivially copyable, 16-byte aligned and live in SSE
+// registers (Vec3d in a pair of them), with the usual operators
+// implemented on the packed lanes:
+//
+//    a * b          dot product          a ^ b          cross product
+//    a % b          componentwise        minimum/maximum componentwise
+//    normalize(a)   unit vector          length/length2
+//
+// The unused fourth lane of the 3-vectors is kept at zero so dot products
+// can sum all lanes.  load()/store() convert to and from the vec.h types.
+//
+// vecbench measures these against vec.h.  Packed Vec3d does not win
+// reliably (the triangle edge tests run slower), so the tracer keeps
+// vec.h for its 3-vectors and uses packed lanes only where four boxes are
+// tested at once, in BoundingBox4.
+//
+// Builds without SSE2, or with -DRAY_NO_SIMD, fall back to plain scalar
+// code with the same interface, so callers never need their own #ifdefs.
+// Compiling with -mavx gets the VEX encodings of the same operations; the
+// types deliberately stop at 16-byte alignment, which is all operator new
+// promises before C++17, so they can be kept in std::vector.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+
+#include "vec.h"
+
+#if !defined(RAY_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define RAY_SIMD_SSE2 1
+#include <emmintrin.h>
+#endif
+
+
+namespace simd {
+
+//==========[ Vec4f / Vec3f ]==============================
+
+#ifdef RAY_SIMD_SSE2
+
+struct alignas(16) Vec4f {
+	__m128 m;
+
+	Vec4f() = default;
+	static Vec4f make( float x, float y, float z, float w )
+		{ Vec4f r; r.m = _mm_set_ps( w, z, y, x ); return r; }
+	static Vec4f splat( float d )
+		{ Vec4f r; r.m = _mm_set1_ps( d ); return r; }
+	static Vec4f wrap( __m128 v ) { Vec4f r; r.m = v; return r; }
+
+	float operator []( int i ) const
+		{ alignas(16) float t[4]; _mm_store_ps( t, m ); return t[i]; }
+};
+
+inline Vec4f operator +( Vec4f a, Vec4f b ) { return Vec4f::wrap( _mm_add_ps( a.m, b.m ) ); }
+inline Vec4f operator -( Vec4f a, Vec4f b ) { return Vec4f::wrap( _mm_sub_ps( a.m, b.m ) ); }
+inline Vec4f operator -( Vec4f a ) { return Vec4f::wrap( _mm_sub_ps( _mm_setzero_ps(), a.m ) ); }
+inline Vec4f operator %( Vec4f a, Vec4f b ) { return Vec4f::wrap( _mm_mul_ps( a.m, b.m ) ); }
+inline Vec4f operator *( Vec4f a, float d ) { return Vec4f::wrap( _mm_mul_ps( a.m, _mm_set1_ps( d ) ) ); }
+inline Vec4f operator *( float d, Vec4f a ) { return a * d; }
+inline Vec4f operator /( Vec4f a, float d ) { return Vec4f::wrap( _mm_div_ps( a.m, _mm_set1_ps( d ) ) ); }
+inline Vec4f minimum( Vec4f a, Vec4f b ) { return Vec4f::wrap( _mm_min_ps( a.m, b.m ) ); }
+inline Vec4f maximum( Vec4f a, Vec4f b ) { return Vec4f::wrap( _mm_max_ps( a.m, b.m ) ); }
+
+// sum of all four lanes
+inline float hsum( __m128 v ) {
+	__m128 s = _mm_add_ps( v, _mm_movehl_ps( v, v ) );
+	s = _mm_add_ss( s, _mm_shuffle_ps( s, s, 1 ) );
+	return _mm_cvtss_f32( s );
+}
+
+inline float operator *( Vec4f a, Vec4f b ) { return hsum( _mm_mul_ps( a.m, b.m ) ); }
+
+struct alignas(16) Vec3f {
+	__m128 m;
+
+	Vec3f() = default;
+	static Vec3f make( float x, float y, float z )
+		{ Vec3f r; r.m = _mm_set_ps( 0.0f, z, y, x ); return r; }
+	static Vec3f wrap( __m128 v ) { Vec3f r; r.m = v; return r; }
+
+	float operator []( int i ) const
+		{ alignas(16) float t[4]; _mm_store_ps( t, m ); return t[i]; }
+};
+
+inline Vec3f operator +( Vec3f a, Vec3f b ) { return Vec3f::wrap( _mm_add_ps( a.m, b.m ) ); }
+inline Vec3f operator -( Vec3f a, Vec3f b ) { return Vec3f::wrap( _mm_sub_ps( a.m, b.m ) ); }
+inline Vec3f operator -( Vec3f a ) { return Vec3f::wrap( _mm_sub_ps( _mm_setzero_ps(), a.m ) ); }
+inline Vec3f operator %( Vec3f a, Vec3f b ) { return Vec3f::wrap( _mm_mul_ps( a.m, b.m ) ); }
+inline Vec3f operator *( Vec3f a, float d ) { return Vec3f::wrap( _mm_mul_ps( a.m, _mm_set1_ps( d ) ) ); }
+inline Vec3f operator *( float d, Vec3f a ) { return a * d; }
+inline Vec3f operator /( Vec3f a, float d ) { return Vec3f::wrap( _mm_div_ps( a.m, _mm_set1_ps( d ) ) ); }
+inline Vec3f minimum( Vec3f a, Vec3f b ) { return Vec3f::wrap( _mm_min_ps( a.m, b.m ) ); }
+inline Vec3f maximum( Vec3f a, Vec3f b ) { return Vec3f::wrap( _mm_max_ps( a.m, b.m ) ); }
+inline float operator *( Vec3f a, Vec3f b ) { return hsum( _mm_mul_ps( a.m, b.m ) ); }
+
+inline Vec3f operator ^( Vec3f a, Vec3f b ) {
+	// a.yzx * b.zxy - a.zxy * b.yzx, computed as (a * b.yzx - a.yzx * b).yzx
+	__m128 a_yzx = _mm_shuffle_ps( a.m, a.m, _MM_SHUFFLE( 3, 0, 2, 1 ) );
+	__m128 b_yzx = _mm_shuffle_ps( b.m, b.m, _MM_SHUFFLE( 3, 0, 2, 1 ) );
+	__m128 c = _mm_sub_ps( _mm_mul_ps( a.m, b_yzx ), _mm_mul_ps( a_yzx, b.m ) );
+	return Vec3f::wrap( _mm_shuffle_ps( c, c, _MM_SHUFFLE( 3, 0, 2, 1 ) ) );
+}
+
+#else // !RAY_SIMD_SSE2
+
+struct alignas(16) Vec4f {
+	float n[4];
+
+	Vec4f() = default;
+	static Vec4f make( float x, float y, float z, float w )
+		{ Vec4f r; r.n[0] = x; r.n[1] = y; r.n[2] = z; r.n[3] = w; return r; }
+	static Vec4f splat( float d ) { return make( d, d, d, d ); }
+
+	float operator []( int i ) const { return n[i]; }
+};
+
+inline Vec4f operator +( Vec4f a, Vec4f b ) { return Vec4f::make( a[0]+b[0], a[1]+b[1], a[2]+b[2], a[3]+b[3] ); }
+inline Vec4f operator -( Vec4f a, Vec4f b ) { return Vec4f::make( a[0]-b[0], a[1]-b[1], a[2]-b[2], a[3]-b[3] ); }
+inline Vec4f operator -( Vec4f a ) { return Vec4f::make( -a[0], -a[1], -a[2], -a[3] ); }
+inline Vec4f operator %( Vec4f a, Vec4f b ) { return Vec4f::make( a[0]*b[0], a[1]*b[1], a[2]*b[2], a[3]*b[3] ); }
+inline Vec4f operator *( Vec4f a, float d ) { return Vec4f::make( a[0]*d, a[1]*d, a[2]*d, a[3]*d ); }
+inline Vec4f operator *( float d, Vec4f a ) { return a * d; }
+inline Vec4f operator /( Vec4f a, float d ) { return Vec4f::make( a[0]/d, a[1]/d, a[2]/d, a[3]/d ); }
+inline Vec4f minimum( Vec4f a, Vec4f b )
+	{ return Vec4f::make( std::min(a[0],b[0]), std::min(a[1],b[1]), std::min(a[2],b[2]), std::min(a[3],b[3]) ); }
+inline Vec4f maximum( Vec4f a, Vec4f b )
+	{ return Vec4f::make( std::max(a[0],b[0]), std::max(a[1],b[1]), std::max(a[2],b[2]), std::max(a[3],b[3]) ); }
+inline float operator *( Vec4f a, Vec4f b ) { return a[0]*b[0] + a[1]*b[1] + a[2]*b[2] + a[3]*b[3]; }
+
+struct alignas(16) Vec3f {
+	float n[4];
+
+	Vec3f() = default;
+	static Vec3f make( float x, float y, float z )
+		{ Vec3f r; r.n[0] = x; r.n[1] = y; r.n[2] = z; r.n[3] = 0.0f; return r; }
+
+	float operator []( int i ) const { return n[i]; }
+};
+
+inline Vec3f operator +( Vec3f a, Vec3f b ) { return Vec3f::make( a[0]+b[0], a[1]+b[1], a[2]+b[2] ); }
+inline Vec3f operator -( Vec3f a, Vec3f b ) { return Vec3f::make( a[0]-b[0], a[1]-b[1], a[2]-b[2] ); }
+inline Vec3f operator -( Vec3f a ) { return Vec3f::make( -a[0], -a[1], -a[2] ); }
+inline Vec3f operator %( Vec3f a, Vec3f b ) { return Vec3f::make( a[0]*b[0], a[1]*b[1], a[2]*b[2] ); }
+inline Vec3f operator *( Vec3f a, float d ) { return Vec3f::make( a[0]*d, a[1]*d, a[2]*d ); }
+inline Vec3f operator *( float d, Vec3f a ) { return a * d; }
+inline Vec3f operator /( Vec3f a, float d ) { return Vec3f::make( a[0]/d, a[1]/d, a[2]/d ); }
+inline Vec3f minimum( Vec3f a, Vec3f b ) { return Vec3f::make( std::min(a[0],b[0]), std::min(a[1],b[1]), std::min(a[2],b[2]) ); }
+inline Vec3f maximum( Vec3f a, Vec3f b ) { return Vec3f::make( std::max(a[0],b[0]), std::max(a[1],b[1]), std::max(a[2],b[2]) ); }
+inline float operator *( Vec3f a, Vec3f b ) { return a[0]*b[0] + a[1]*b[1] + a[2]*b[2]; }
+inline Vec3f operator ^( Vec3f a, Vec3f b ) {
+	return Vec3f::make( a[1]*b[2] - a[2]*b[1], a[2]*b[0] - a[0]*b[2], a[0]*b[1] - a[1]*b[0] );
+}
+
+#endif // RAY_SIMD_SSE2
+
+//==========[ Vec3d ]======================================
+
+#if defined(RAY_SIMD_SSE2)
+
+// Two SSE2 registers: (x, y) and (z, 0).
+struct alignas(16) Vec3d {
+	__m128d xy, z0;
+
+	Vec3d() = default;
+	static Vec3d make( double x, double y, double z )
+		{ Vec3d r; r.xy = _mm_set_pd( y, x ); r.z0 = _mm_set_sd( z ); return r; }
+	static Vec3d wrap( __m128d xy, __m128d z0 ) { Vec3d r; r.xy = xy; r.z0 = z0; return r; }
+
+	double operator []( int i ) const
+		{ alignas(16) double t[2]; _mm_store_pd( t, i < 2 ? xy : z0 ); return t[i & 1]; }
+};
+
+inline Vec3d operator +( Vec3d a, Vec3d b ) { return Vec3d::wrap( _mm_add_pd( a.xy, b.xy ), _mm_add_pd( a.z0, b.z0 ) ); }
+inline Vec3d operator -( Vec3d a, Vec3d b ) { return Vec3d::wrap( _mm_sub_pd( a.xy, b.xy ), _mm_sub_pd( a.z0, b.z0 ) ); }
+inline Vec3d operator -( Vec3d a ) {
+	__m128d zero = _mm_setzero_pd();
+	return Vec3d::wrap( _mm_sub_pd( zero, a.xy ), _mm_sub_pd( zero, a.z0 ) );
+}
+inline Vec3d operator %( Vec3d a, Vec3d b ) { return Vec3d::wrap( _mm_mul_pd( a.xy, b.xy ), _mm_mul_pd( a.z0, b.z0 ) ); }
+inline Vec3d operator *( Vec3d a, double d ) {
+	__m128d s = _mm_set1_pd( d );
+	return Vec3d::wrap( _mm_mul_pd( a.xy, s ), _mm_mul_pd( a.z0, s ) );
+}
+inline Vec3d operator *( double d, Vec3d a ) { return a * d; }
+inline Vec3d operator /( Vec3d a, double d ) {
+	__m128d s = _mm_set1_pd( d );
+	return Vec3d::wrap( _mm_div_pd( a.xy, s ), _mm_div_pd( a.z0, s ) );
+}
+inline Vec3d minimum( Vec3d a, Vec3d b ) { return Vec3d::wrap( _mm_min_pd( a.xy, b.xy ), _mm_min_pd( a.z0, b.z0 ) ); }
+inline Vec3d maximum( Vec3d a, Vec3d b ) { return Vec3d::wrap( _mm_max_pd( a.xy, b.xy ), _mm_max_pd( a.z0, b.z0 ) ); }
+
+inline double operator *( Vec3d a, Vec3d b ) {
+	__m128d s = _mm_add_pd( _mm_mul_pd( a.xy, b.xy ), _mm_mul_pd( a.z0, b.z0 ) );
+	return _mm_cvtsd_f64( _mm_add_sd( s, _mm_unpackhi_pd( s, s ) ) );
+}
+
+inline Vec3d operator ^( Vec3d a, Vec3d b ) {
+	__m128d a_yz = _mm_shuffle_pd( a.xy, a.z0, 1 );		// (ay, az)
+	__m128d a_zx = _mm_shuffle_pd( a.z0, a.xy, 0 );		// (az, ax)
+	__m128d b_yz = _mm_shuffle_pd( b.xy, b.z0, 1 );
+	__m128d b_zx = _mm_shuffle_pd( b.z0, b.xy, 0 );
+	__m128d xy = _mm_sub_pd( _mm_mul_pd( a_yz, b_zx ), _mm_mul_pd( a_zx, b_yz ) );
+	__m128d t = _mm_mul_pd( a.xy, _mm_shuffle_pd( b.xy, b.xy, 1 ) );	// (ax*by, ay*bx)
+	__m128d z = _mm_sub_sd( t, _mm_unpackhi_pd( t, t ) );
+	return Vec3d::wrap( xy, _mm_move_sd( _mm_setzero_pd(), z ) );
+}
+
+#else
+
+struct alignas(16) Vec3d {
+	double n[4];
+
+	Vec3d() = default;
+	static Vec3d make( double x, double y, double z )
+		{ Vec3d r; r.n[0] = x; r.n[1] = y; r.n[2] = z; r.n[3] = 0.0; return r; }
+
+	double operator []( int i ) const { return n[i]; }
+};
+
+inline Vec3d operator +( Vec3d a, Vec3d b ) { return Vec3d::make( a[0]+b[0], a[1]+b[1], a[2]+b[2] ); }
+inline Vec3d operator -( Vec3d a, Vec3d b ) { return Vec3d::make( a[0]-b[0], a[1]-b[1], a[2]-b[2] ); }
+inline Vec3d operator -( Vec3d a ) { return Vec3d::make( -a[0], -a[1], -a[2] ); }
+inline Vec3d operator %( Vec3d a, Vec3d b ) { return Vec3d::make( a[0]*b[0], a[1]*b[1], a[2]*b[2] ); }
+inline Vec3d operator *( Vec3d a, double d ) { return Vec3d::make( a[0]*d, a[1]*d, a[2]*d ); }
+inline Vec3d operator *( double d, Vec3d a ) { return a * d; }
+inline Vec3d operator /( Vec3d a, double d ) { return Vec3d::make( a[0]/d, a[1]/d, a[2]/d ); }
+inline Vec3d minimum( Vec3d a, Vec3d b ) { return Vec3d::make( std::min(a[0],b[0]), std::min(a[1],b[1]), std::min(a[2],b[2]) ); }
+inline Vec3d maximum( Vec3d a, Vec3d b ) { return Vec3d::make( std::max(a[0],b[0]), std::max(a[1],b[1]), std::max(a[2],b[2]) ); }
+inline double operator *( Vec3d a, Vec3d b ) { return a[0]*b[0] + a[1]*b[1] + a[2]*b[2]; }
+inline Vec3d operator ^( Vec3d a, Vec3d b ) {
+	return Vec3d::make( a[1]*b[2] - a[2]*b[1], a[2]*b[0] - a[0]*b[2], a[0]*b[1] - a[1]*b[0] );
+}
+
+#endif
+
+//==========[ Shared helpers ]=============================
+
+inline float length2( Vec3f a ) { return a * a; }
+inline float length( Vec3f a ) { return std::sqrt( a * a ); }
+inline Vec3f normalize( Vec3f a ) { return a * ( 1.0f / length( a ) ); }
+
+inline double length2( Vec3d a ) { return a * a; }
+inline double length( Vec3d a ) { return std::sqrt( a * a ); }
+inline Vec3d normalize( Vec3d a ) { return a * ( 1.0 / length( a ) ); }
+
+inline Vec3d load( const ::Vec3<double>& v ) { return Vec3d::make( v[0], v[1], v[2] ); }
+inline Vec3f load( const ::Vec3<float>& v ) { return Vec3f::make( v[0], v[1], v[2] ); }
+inline Vec4f load( const ::Vec4<float>& v ) { return Vec4f::make( v[0], v[1], v[2], v[3] ); }
+
+inline ::Vec3<double> store( Vec3d v ) { return ::Vec3<double>( v[0], v[1], v[2] ); }
+inline ::Vec3<float> store( Vec3f v ) { return ::Vec3<float>( v[0], v[1], v[2] ); }
+inline ::Vec4<float> store( Vec4f v ) { return ::Vec4<float>( v[0], v[1], v[2], v[3] ); }
+
+static_assert( std::is_trivial<Vec3f>::value && std::is_trivial<Vec3d>::value &&
+               std::is_trivial<Vec4f>::value, "simd vectors must stay POD" );
+
+} // namespace simd
+
+static_assert( std::is_trivially_copyable< ::Vec3<double> >::value &&
+               std::is_trivially_copyable< ::Vec4<double> >::value,
+               "vec.h vectors must stay trivially copyable" );
+
+#endif // __SIMD_HEADER__
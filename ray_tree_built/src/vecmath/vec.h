@@ -134,13 +134,11 @@ public:
 	Vec2() { n[0] = 0.0; n[1] = 0.0; }
 	Vec2( const T x, const T y )
 		{ n[0] = x; n[1] = y; }
-	Vec2( const Vec2<T>& v )
-		{ n[0] = v[0]; n[1] = v[1]; }
+	Vec2( const Vec2<T>& v ) = default;
 
 	//---[ Equal Operators ]---------------------
 
-	Vec2<T>& operator=( const Vec2<T>& v )
-		{ n[0] = v[0]; n[1] = v[1]; return *this; }
+	Vec2<T>& operator=( const Vec2<T>& v ) = default;
 	Vec2<T>& operator +=( const Vec2<T>& v )
 		{ n[0] += v[0]; n[1] += v[1]; return *this; }
 	Vec2<T>& operator -= ( const Vec2<T>& v )
@@ -206,16 +204,16 @@ public:
 	Vec3() { n[0] = 0.0; n[1] = 0.0; n[2] = 0.0; }
 	Vec3( const T x, const T y, const T z )
 		{ n[0] = x; n[1] = y; n[2] = z; }
-	Vec3( const Vec3<T>& v )
-		{ n[0] = v[0]; n[1] = v[1]; n[2] = v[2]; }
+	Vec3( const Vec3<T>& v ) = default;
 	Vec3( int ) { n[0] = 0.0; n[1] = 0.0; n[2] = 0.0; }
 	Vec3( const Vec4<T>& v )
 		{ n[0] = v[0]; n[1] = v[1]; n[2] = v[2]; }
+	template <class U> Vec3( const Vec3<U>& v )
+		{ n[0] = T( v[0] ); n[1] = T( v[1] ); n[2] = T( v[2] ); }
 
 	//---[ Equal Operators ]---------------------
 
-	Vec3<T>& operator=( const Vec3<T>& v )
-		{ n[0] = v[0]; n[1] = v[1]; n[2] = v[2]; return *this; }
+	Vec3<T>& operator=( const Vec3<T>& v ) = default;
 	Vec3<T>& operator +=( const Vec3<T>& v )
 		{ n[0] += v[0]; n[1] += v[1]; n[2] += v[2]; return *this; }
 	Vec3<T>& operator -= ( const Vec3<T>& v )
@@ -304,6 +302,16 @@ typedef Vec3<int> Vec3i;
 typedef Vec3<float> Vec3f;
 typedef Vec3<double> Vec3d;
 
+// Precision of the geometry side of the tracer: rays, hit distances,
+// bounding boxes and mesh vertices.  Building with -DRAY_SINGLE_PRECISION
+// traces in float; colors and shading stay in double either way.
+#ifdef RAY_SINGLE_PRECISION
+typedef float Scalar;
+#else
+typedef double Scalar;
+#endif
+typedef Vec3<Scalar> Vec3s;
+
 //==========[ class Vec4 ]=================================
 
 template <class T>
@@ -321,14 +329,11 @@ public:
 	Vec4() { n[0] = 0.0; n[1] = 0.0; n[2] = 0.0; n[3] = 0.0; }
 	Vec4( const T x, const T y, const T z, const T w )
 		{ n[0] = x; n[1] = y; n[2] = z; n[3] = w; }
-	Vec4( const Vec4& v )
-		{ n[0] = v[0]; n[1] = v[1]; n[2] = v[2]; n[3] = v[3]; }
+	Vec4( const Vec4& v ) = default;
 
 	//---[ Equal Operators ]---------------------
 
-	Vec4<T>& operator =( const Vec4<T>& v )
-		{ n[0] = v[0]; n[1] = v[1]; n[2] = v[2]; n[3] = v[3];
-		  return *this; }
+	Vec4<T>& operator =( const Vec4<T>& v ) = default;
 	Vec4<T>& operator +=( const Vec4<T>& v )
 		{ n[0] += v[0]; n[1] += v[1]; n[2] += v[2]; n[3] += v[3];
 		  return *this; }